@@ -0,0 +1,134 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace sr
+{
+namespace util
+{
+	namespace
+	{
+		struct ScopeTotals
+		{
+			std::atomic<const char*> name;
+			std::atomic<uint64_t> count, bytes;
+		};
+
+		ScopeTotals scopes[MAX_ALLOCATION_SCOPES];
+		std::atomic<size_t> scope_count(1);
+		std::mutex scope_mutex;
+	}
+
+	size_t allocation_scope_id(const char* name)
+	{
+		std::lock_guard<std::mutex> lock(scope_mutex);
+
+		size_t n = scope_count.load();
+		for (size_t i = 1; i < n; i++)
+		{
+			if (std::strcmp(scopes[i].name.load(), name) == 0) return i;
+		}
+
+		// Past the limit, the allocations fall back to the unnamed scope rather than failing
+		if (n == MAX_ALLOCATION_SCOPES) return 0;
+
+		scopes[n].name.store(name);
+		scope_count.store(n + 1);
+		return n;
+	}
+
+	bool allocation_stats_enabled()
+	{
+#ifdef ALLOCATION_STATS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+#ifdef ALLOCATION_STATS
+	thread_local size_t current_allocation_scope = 0;
+
+	uint64_t allocation_count(size_t scope)
+	{
+		return scopes[scope].count.load(std::memory_order_relaxed);
+	}
+
+	void count_allocation(size_t bytes)
+	{
+		ScopeTotals& scope = scopes[current_allocation_scope];
+		scope.count.fetch_add(1, std::memory_order_relaxed);
+		scope.bytes.fetch_add(bytes, std::memory_order_relaxed);
+	}
+#endif
+
+	AllocationReport::AllocationReport()
+	{
+		for (size_t i = 0; i < MAX_ALLOCATION_SCOPES; i++)
+		{
+			count[i] = 0;
+			bytes[i] = 0;
+		}
+	}
+
+	void AllocationReport::skip()
+	{
+		size_t n = scope_count.load();
+		for (size_t i = 0; i < n; i++)
+		{
+			count[i] = scopes[i].count.load(std::memory_order_relaxed);
+			bytes[i] = scopes[i].bytes.load(std::memory_order_relaxed);
+		}
+	}
+
+	void AllocationReport::write(std::ostream& out, const char* prefix)
+	{
+		if (!allocation_stats_enabled()) return;
+
+		size_t n = scope_count.load();
+		for (size_t i = 0; i < n; i++)
+		{
+			uint64_t new_count = scopes[i].count.load(std::memory_order_relaxed);
+			uint64_t new_bytes = scopes[i].bytes.load(std::memory_order_relaxed);
+
+			if (new_count != count[i])
+			{
+				const char* name = i == 0 ? "other" : scopes[i].name.load();
+				out << prefix << name << " " << new_count - count[i] << " " << new_bytes - bytes[i] << std::endl;
+			}
+
+			count[i] = new_count;
+			bytes[i] = new_bytes;
+		}
+	}
+}
+}
+
+#ifdef ALLOCATION_STATS
+// Replaces the global allocation functions, only to count the calls. The array and nothrow forms call these.
+void* operator new(std::size_t size)
+{
+	sr::util::count_allocation(size);
+
+	if (size == 0) size = 1;
+
+	while (true)
+	{
+		void* ptr = std::malloc(size);
+		if (ptr) return ptr;
+
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+#endif
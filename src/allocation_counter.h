@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace sr
+{
+namespace util
+{
+	/** The most named scopes that allocations can be attributed to, including the unnamed scope 0. */
+	const size_t MAX_ALLOCATION_SCOPES = 32;
+
+	/**
+	 * Gets the id of the allocation scope called `name`, registering it on first use. `name` must outlive the program,
+	 * e.g. a string literal. Scope 0 collects the allocations made outside any scope.
+	 * The integrator is meant to reach a steady state where a timeblock makes no allocations, so the executors
+	 * run each part of their loop in a scope, and record the allocations of those scopes in their last loop.
+	 */
+	size_t allocation_scope_id(const char* name);
+
+#ifdef ALLOCATION_STATS
+	/** The scope that the allocations of this thread are attributed to. */
+	extern thread_local size_t current_allocation_scope;
+
+	/**
+	 * Gets the number of heap allocations attributed to `scope` so far, on any thread. Every `operator new` is counted,
+	 * as are the allocations of `aligned_allocator`, which bypass it.
+	 */
+	uint64_t allocation_count(size_t scope);
+
+	/** Counts an allocation of `bytes` towards the current scope of this thread. */
+	void count_allocation(size_t bytes);
+
+	/** Attributes the allocations of this thread to a scope until destroyed. Scopes nest; the innermost one counts. */
+	class AllocationScope
+	{
+	public:
+		inline explicit AllocationScope(size_t id) : previous(current_allocation_scope) { current_allocation_scope = id; }
+		inline ~AllocationScope() { current_allocation_scope = previous; }
+
+		AllocationScope(const AllocationScope&) = delete;
+		AllocationScope& operator=(const AllocationScope&) = delete;
+
+	private:
+		size_t previous;
+	};
+#else
+	// Without ALLOCATION_STATS, allocations are not counted and the scopes compile away
+	inline uint64_t allocation_count(size_t) { return 0; }
+	inline void count_allocation(size_t) { }
+
+	class AllocationScope
+	{
+	public:
+		inline explicit AllocationScope(size_t) { }
+	};
+#endif
+
+	/** Whether this build counts allocations, i.e. was built with ALLOCATION_STATS. */
+	bool allocation_stats_enabled();
+
+	/** Reports the allocations of each scope in intervals. */
+	class AllocationReport
+	{
+	public:
+		AllocationReport();
+
+		/**
+		 * Writes the allocations and bytes of each scope that allocated since the last call, one line each,
+		 * starting with `prefix`. Writes nothing if allocations are not counted.
+		 */
+		void write(std::ostream& out, const char* prefix);
+
+		/** Starts the next interval without writing the last one. */
+		void skip();
+
+	private:
+		uint64_t count[MAX_ALLOCATION_SCOPES], bytes[MAX_ALLOCATION_SCOPES];
+	};
+}
+}
@@ -0,0 +1,279 @@
+#include "autotune.h"
+#include "executor_facade.h"
+#include "kernels.h"
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace sr
+{
+namespace exec
+{
+	namespace
+	{
+		/** The most particles that the trials integrate. */
+		const size_t SAMPLE_SIZE = 4096;
+
+		/** The number of intervals of `Time-Block-Size` steps that each trial times, after one interval of warm-up. */
+		const uint32_t TRIAL_INTERVALS = 2;
+
+		std::string cpu_model()
+		{
+			std::ifstream cpuinfo("/proc/cpuinfo");
+			std::string line;
+
+			while (std::getline(cpuinfo, line))
+			{
+				if (line.compare(0, 10, "model name") != 0) continue;
+
+				size_t colon = line.find(':');
+				if (colon == std::string::npos) continue;
+
+				size_t begin = line.find_first_not_of(" \t", colon + 1);
+				if (begin != std::string::npos) return line.substr(begin);
+			}
+
+			return "unknown";
+		}
+
+		/** Gets the chunk size that gives each of `num_thread` threads `chunks_per_thread` chunks of `particle_count` particles, or 0 for the default. */
+		uint32_t chunk_size(uint32_t chunks_per_thread, size_t particle_count, size_t num_thread)
+		{
+			if (chunks_per_thread == 0) return 0;
+			return static_cast<uint32_t>(std::max<size_t>(1, particle_count / (num_thread * chunks_per_thread)));
+		}
+
+		std::string describe(const TuningParameters& params)
+		{
+			std::ostringstream ss;
+			ss << "CPU-ISA " << params.cpu_isa << ", CPU-Thread-Count " << params.num_thread
+				<< ", chunks per thread " << params.chunks_per_thread << ", CPU-Time-Block-Size " << params.cpu_tbsize;
+			return ss.str();
+		}
+
+		/** Integrates a copy of `sample` with the parameters, and returns the time per step in milliseconds. */
+		double run_trial(const HostData& sample, const Configuration& base, const TuningParameters& params)
+		{
+			Configuration config = base;
+			config.cpu_isa = params.cpu_isa;
+			config.num_thread = params.num_thread;
+			config.cpu_chunk_size = chunk_size(params.chunks_per_thread, sample.particles.n_alive(), params.num_thread);
+			config.cpu_tbsize = params.cpu_tbsize;
+			config.adaptive_tbsize = false;
+
+			HostData hd = sample;
+			std::ostream discard(nullptr);
+
+			ExecutorFacade ex(hd, config, discard);
+			ex.t = config.t_0;
+			ex.init();
+
+			do
+			{
+				ex.loop(nullptr, nullptr);
+			}
+			while (!ex.interval_finished);
+
+			uint64_t steps = 0;
+			auto start = std::chrono::high_resolution_clock::now();
+
+			for (uint32_t interval = 0; interval < TRIAL_INTERVALS; )
+			{
+				ex.loop(nullptr, nullptr);
+				steps += ex.timeblock_steps;
+				if (ex.interval_finished) interval++;
+			}
+
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			ex.finish();
+
+			return elapsed.count() / static_cast<double>(steps);
+		}
+
+		/**
+		 * Runs a trial for each candidate value of one parameter, with the others as in `best`,
+		 * and keeps the fastest in `best`. The value in `best` is not timed again.
+		 */
+		template<typename T>
+		void tune(const HostData& sample, const Configuration& config, std::ostream& log,
+				TuningParameters& best, double& best_time, T TuningParameters::*parameter, const std::vector<T>& candidates)
+		{
+			TuningParameters start = best;
+
+			for (const T& value : candidates)
+			{
+				if (best_time >= 0 && value == start.*parameter) continue;
+
+				TuningParameters params = start;
+				params.*parameter = value;
+
+				double time = run_trial(sample, config, params);
+				log << "Autotune: " << describe(params) << ": " << time << " ms per step" << std::endl;
+
+				if (best_time < 0 || time < best_time)
+				{
+					best = params;
+					best_time = time;
+				}
+			}
+		}
+	}
+
+	std::string tuning_key(size_t planet_count, size_t particle_count)
+	{
+		size_t bucket = 1;
+		while (bucket <= particle_count / 4) bucket *= 4;
+
+		std::ostringstream ss;
+		ss << cpu_model() << ", " << planet_count << " planets, " << bucket << "+ particles";
+		return ss.str();
+	}
+
+	std::string tuning_cache_path(const Configuration& config)
+	{
+		if (config.tuning_cache == "none") return "";
+		if (!config.tuning_cache.empty()) return config.tuning_cache;
+
+		const char* home = std::getenv("HOME");
+		if (!home || !*home) return "";
+
+		return sr::util::joinpath(home, ".glisse-tuning");
+	}
+
+	bool load_tuning(const std::string& path, const std::string& key, TuningParameters* params)
+	{
+		std::ifstream cache(path);
+		std::string line;
+
+		// One tuning per line: the key, a tab, and the parameters
+		while (std::getline(cache, line))
+		{
+			size_t tab = line.rfind('\t');
+			if (tab == std::string::npos || line.compare(0, tab, key) != 0 || tab != key.size()) continue;
+
+			std::istringstream ss(line.substr(tab + 1));
+			TuningParameters found;
+			if (ss >> found.cpu_isa >> found.num_thread >> found.chunks_per_thread >> found.cpu_tbsize)
+			{
+				*params = found;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void save_tuning(const std::string& path, const std::string& key, const TuningParameters& params)
+	{
+		std::vector<std::string> lines;
+
+		{
+			std::ifstream cache(path);
+			std::string line;
+
+			while (std::getline(cache, line))
+			{
+				if (line.compare(0, key.size() + 1, key + "\t") != 0) lines.push_back(line);
+			}
+		}
+
+		std::ostringstream entry;
+		entry << key << "\t" << params.cpu_isa << " " << params.num_thread << " " << params.chunks_per_thread << " " << params.cpu_tbsize;
+		lines.push_back(entry.str());
+
+		std::ofstream cache(path);
+		for (const std::string& line : lines)
+		{
+			cache << line << std::endl;
+		}
+
+		if (!cache)
+		{
+			throw std::runtime_error("Error: could not write the tuning cache " + path);
+		}
+	}
+
+	void apply_tuning(const TuningParameters& params, size_t particle_count, Configuration* config)
+	{
+		if (config->cpu_isa == "auto") config->cpu_isa = params.cpu_isa;
+		if (config->num_thread == 0) config->num_thread = params.num_thread;
+
+		// As many chunks per thread as in the trials, however many particles this run has
+		if (config->cpu_chunk_size == 0)
+		{
+			size_t num_thread = config->num_thread > 0 ? config->num_thread : std::max(1u, std::thread::hardware_concurrency());
+			config->cpu_chunk_size = chunk_size(params.chunks_per_thread, particle_count, num_thread);
+		}
+
+		// A length tuned for a longer Time-Block-Size does not fit
+		if (config->cpu_tbsize == 0 && params.cpu_tbsize <= config->tbsize) config->cpu_tbsize = params.cpu_tbsize;
+	}
+
+	TuningParameters autotune(const HostData& hd, const Configuration& config, std::ostream& log)
+	{
+		// An even spread over the alive particles, in the order of the input
+		size_t n_alive = hd.particles.n_alive();
+		size_t sample_size = std::min(n_alive, SAMPLE_SIZE);
+
+		std::vector<size_t> indices(sample_size);
+		for (size_t i = 0; i < sample_size; i++)
+		{
+			indices[i] = i * n_alive / sample_size;
+		}
+
+		HostData sample;
+		sample.planets = hd.planets;
+		hd.particles.filter(indices, sample.particles);
+
+		log << "Autotune: timing " << sample_size << " of " << n_alive << " particles" << std::endl;
+
+		TuningParameters best = { "auto", 1, 0, config.tbsize };
+		double best_time = -1;
+
+		size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<uint32_t> threads;
+		for (size_t n = 1; n < hardware_threads; n *= 2)
+		{
+			threads.push_back(static_cast<uint32_t>(n));
+		}
+		threads.push_back(static_cast<uint32_t>(hardware_threads));
+		tune(sample, config, log, best, best_time, &TuningParameters::num_thread, threads);
+
+		// The kernel sets are only used by the particle-major engine
+		if (config.cpu_particle_major && config.integrator == IntegratorType::WH)
+		{
+			std::vector<std::string> isas;
+			for (const sr::kernels::IsaLevel& level : sr::kernels::ISA_LEVELS)
+			{
+				if (sr::kernels::supported(level.isa)) isas.push_back(level.name);
+			}
+			tune(sample, config, log, best, best_time, &TuningParameters::cpu_isa, isas);
+		}
+
+		std::vector<uint32_t> tbsizes;
+		for (uint32_t tbsize = config.tbsize; tbsize >= std::max<uint32_t>(1, config.tbsize / 32); tbsize /= 2)
+		{
+			tbsizes.push_back(tbsize);
+			if (tbsize == 1) break;
+		}
+		tune(sample, config, log, best, best_time, &TuningParameters::cpu_tbsize, tbsizes);
+
+		// Down to chunks of 16 particles on the sample
+		std::vector<uint32_t> chunks = { 0 };
+		for (uint32_t per_thread = 1; per_thread * best.num_thread * 16 <= sample_size; per_thread *= 4)
+		{
+			chunks.push_back(per_thread);
+		}
+		tune(sample, config, log, best, best_time, &TuningParameters::chunks_per_thread, chunks);
+
+		log << "Autotune: picked " << describe(best) << std::endl;
+		return best;
+	}
+}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "data.h"
+#include <ostream>
+#include <string>
+
+namespace sr
+{
+namespace exec
+{
+	using namespace sr::data;
+
+	/**
+	 * The CPU engine parameters that the autotuner picks. None of them change the results: the kernel sets are bit-identical,
+	 * and the timeblocks never cross the intervals of `Time-Block-Size` steps that the outputs and the resyncs count.
+	 * The chunk size is kept as the number of chunks per thread, or 0 for the default, so that it scales with the particle count.
+	 */
+	struct TuningParameters
+	{
+		std::string cpu_isa;
+		uint32_t num_thread, chunks_per_thread, cpu_tbsize;
+	};
+
+	/**
+	 * Gets the key that tunings are cached under on this machine: the CPU model, the planet count,
+	 * and the particle count rounded down to a power of 4, so that a tuning is only reused for runs of a similar size.
+	 */
+	std::string tuning_key(size_t planet_count, size_t particle_count);
+
+	/**
+	 * Gets the path of the tuning cache for `config`: `Tuning-Cache` if it is set, otherwise `.glisse-tuning` in the home directory.
+	 * Returns an empty string if the cache is disabled with "none", or if there is no home directory.
+	 */
+	std::string tuning_cache_path(const Configuration& config);
+
+	/** Looks up the tuning cached under `key` in the cache file at `path`. Returns false if there is none. */
+	bool load_tuning(const std::string& path, const std::string& key, TuningParameters* params);
+
+	/** Caches the tuning under `key` in the cache file at `path`, replacing an earlier one. */
+	void save_tuning(const std::string& path, const std::string& key, const TuningParameters& params);
+
+	/**
+	 * Fills in the parameters that `config` leaves to be chosen automatically from `params`:
+	 * `CPU-ISA` auto, and zero `CPU-Thread-Count`, `CPU-Chunk-Size` and `CPU-Time-Block-Size`.
+	 * The chunk size is worked out for `particle_count` particles.
+	 */
+	void apply_tuning(const TuningParameters& params, size_t particle_count, Configuration* config);
+
+	/**
+	 * Picks the parameters by timing short integrations of a sample of the particles in `hd`, one parameter at a time.
+	 * Every trial runs on a fresh copy, so `hd` is untouched. Writes a line per trial to `log`. CPU-only mode only.
+	 */
+	TuningParameters autotune(const HostData& hd, const Configuration& config, std::ostream& log);
+}
+}
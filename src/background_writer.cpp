@@ -0,0 +1,113 @@
+#include "background_writer.h"
+
+#include <algorithm>
+
+namespace sr
+{
+namespace util
+{
+	BackgroundWriter::BackgroundWriter(size_t capacity, const Task& _idle) :
+		_capacity(std::max<size_t>(capacity, 1)), idle(_idle), stopping(false)
+	{
+		thread = std::thread(&BackgroundWriter::writer_main, this);
+	}
+
+	BackgroundWriter::~BackgroundWriter()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		work_cv.notify_all();
+		thread.join();
+	}
+
+	void BackgroundWriter::push(const Task& task)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			rethrow_error();
+
+			space_cv.wait(lock, [this]() { return queue.size() < _capacity || error; });
+			rethrow_error();
+
+			queue.push_back(task);
+		}
+
+		work_cv.notify_all();
+	}
+
+	void BackgroundWriter::drain()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		space_cv.wait(lock, [this]() { return queue.empty() || error; });
+		rethrow_error();
+	}
+
+	size_t BackgroundWriter::depth()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return queue.size();
+	}
+
+	void BackgroundWriter::rethrow_error()
+	{
+		if (error)
+		{
+			std::exception_ptr e = error;
+			error = nullptr;
+			std::rethrow_exception(e);
+		}
+	}
+
+	void BackgroundWriter::writer_main()
+	{
+		while (true)
+		{
+			Task task;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				work_cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+
+				if (queue.empty()) return;
+
+				// The task stays in the queue while it runs, so that it counts towards the depth and the capacity
+				task = queue.front();
+			}
+
+			try
+			{
+				task();
+
+				bool last;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					last = queue.size() == 1;
+				}
+
+				if (last && idle)
+				{
+					idle();
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!error)
+				{
+					error = std::current_exception();
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queue.pop_front();
+			}
+
+			space_cv.notify_all();
+		}
+	}
+}
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace sr
+{
+namespace util
+{
+	/**
+	 * Runs output tasks in order on a dedicated writer thread, so that writing tracks and dumps does not hold up the integrator.
+	 * The queue is bounded: each queued task owns a copy of the state it writes, so the bound caps the memory used.
+	 * When the queue runs empty, the idle function is called, so that output streams are flushed in batches
+	 * rather than after every task.
+	 */
+	class BackgroundWriter
+	{
+	public:
+		using Task = std::function<void()>;
+
+		/** Ctor with the maximum number of queued tasks, and the function to call when the queue runs empty. */
+		BackgroundWriter(size_t capacity, const Task& idle);
+
+		/** Runs the remaining tasks before returning. Exceptions from them are discarded. */
+		~BackgroundWriter();
+
+		BackgroundWriter(const BackgroundWriter&) = delete;
+		BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+
+		/** Queues `task`, blocking while the queue is full. */
+		void push(const Task& task);
+
+		/**
+		 * Blocks until every queued task has run and the idle function has been called.
+		 * If any task threw an exception, the first exception is rethrown here; `push()` does the same.
+		 */
+		void drain();
+
+		/** Gets the number of queued tasks, including the one running. */
+		size_t depth();
+
+		inline size_t capacity() const { return _capacity; }
+
+	private:
+		void writer_main();
+
+		/** Rethrows and clears a stored task exception. `mutex` must be held. */
+		void rethrow_error();
+
+		size_t _capacity;
+		Task idle;
+
+		std::deque<Task> queue;
+		bool stopping;
+		std::exception_ptr error;
+
+		std::mutex mutex;
+		std::condition_variable work_cv, space_cv;
+
+		std::thread thread;
+	};
+}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sr
+{
+namespace util
+{
+	/**
+	 * Hands out buffers that go back to the pool when the last `std::shared_ptr` to them is released, so that output copies of the
+	 * state reuse the memory of earlier ones instead of allocating it again. A buffer keeps whatever it held when it was released.
+	 * Buffers can be released on any thread, and the pool can be destroyed before they are.
+	 */
+	template<typename T>
+	class BufferPool
+	{
+	public:
+		inline BufferPool() : state(std::make_shared<State>()) { }
+
+		BufferPool(const BufferPool&) = delete;
+		BufferPool& operator=(const BufferPool&) = delete;
+
+		/** Gets a released buffer, or a default constructed one if there is none. */
+		std::shared_ptr<T> acquire()
+		{
+			std::unique_ptr<T> buffer;
+
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				if (!state->free.empty())
+				{
+					buffer = std::move(state->free.back());
+					state->free.pop_back();
+				}
+			}
+
+			if (!buffer) buffer.reset(new T());
+
+			std::shared_ptr<State> owner = state;
+			return std::shared_ptr<T>(buffer.release(), [owner](T* released)
+				{
+					std::lock_guard<std::mutex> lock(owner->mutex);
+					owner->free.emplace_back(released);
+				});
+		}
+
+	private:
+		struct State
+		{
+			std::mutex mutex;
+			std::vector<std::unique_ptr<T>> free;
+		};
+
+		std::shared_ptr<State> state;
+	};
+}
+}
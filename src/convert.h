@@ -19,6 +19,7 @@ namespace convert
 	void to_helio(HostData& hd);
 
 	void from_elements(double mu, double a, double e, double i, double capom, double om, double f, f64_3* r, f64_3* v);
+	/** Converts a cartesian state into orbital elements, using the selected `sr::kernels` kernel set. */
 	void to_elements(double mu, f64_3 r, f64_3 v, int* esign = nullptr, double* a = nullptr, double* e = nullptr, double* i = nullptr, double* capom = nullptr, double* om = nullptr, double* f = nullptr);
 }
 }
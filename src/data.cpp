@@ -1,48 +1,62 @@
 #include "data.h"
 #include "util.h"
 #include "convert.h"
+#include "kernels.h"
+#include "text_cursor.h"
+#include "text_format.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
 #include <iomanip>
 #include <limits>
 #include <algorithm>
 #include <numeric>
+#include <cstring>
+#include <thread>
+#include <exception>
 
 namespace sr
 {
 namespace data
 {
-	size_t stable_partition_alive_indices(const std::vector<uint16_t>& flags, size_t begin, size_t length, std::unique_ptr<std::vector<size_t>>* indices)
+	namespace
 	{
-		auto new_indices = std::make_unique<std::vector<size_t>>(length);
-		std::iota(new_indices->begin(), new_indices->end(), 0);
-
-		auto val = std::stable_partition(new_indices->begin(), new_indices->end(), [begin, &flags](size_t index)
-				{ return (flags[index + begin] & 0x00FE) == 0; }) - new_indices->begin() + begin;
-
-		*indices = std::move(new_indices);
-		return val;
+		/**
+		 * Fills `indices` with the stable partition of [begin, begin + length) into the entries whose flags have no bits of `mask` set,
+		 * followed by the rest, and returns the end of the former. The partition runs in the selected CPU kernel set.
+		 * `indices` is resized in place, so a caller that keeps it between calls only allocates when the range grows.
+		 */
+		size_t stable_partition_indices(const std::vector<uint16_t>& flags, uint16_t mask, size_t begin, size_t length, std::vector<size_t>& indices)
+		{
+			indices.resize(length);
+			return sr::kernels::kernels().partition(flags.data() + begin, mask, indices.data(), length) + begin;
+		}
 	}
 
-	size_t stable_partition_unflagged_indices(const std::vector<uint16_t>& flags, size_t begin, size_t length, std::unique_ptr<std::vector<size_t>>* indices)
+	size_t stable_partition_alive_indices(const std::vector<uint16_t>& flags, size_t begin, size_t length, std::vector<size_t>& indices)
 	{
-		auto new_indices = std::make_unique<std::vector<size_t>>(length);
-		std::iota(new_indices->begin(), new_indices->end(), 0);
+		return stable_partition_indices(flags, 0x00FE, begin, length, indices);
+	}
 
-		auto val = std::stable_partition(new_indices->begin(), new_indices->end(), [begin, &flags](size_t index)
-				{ return (flags[index + begin] & 0x00FF) == 0; }) - new_indices->begin() + begin;
+	size_t stable_partition_alive_indices(const std::vector<uint16_t>& flags, size_t begin, size_t length, std::unique_ptr<std::vector<size_t>>* indices)
+	{
+		auto new_indices = std::make_unique<std::vector<size_t>>();
+		size_t end = stable_partition_alive_indices(flags, begin, length, *new_indices);
 
 		*indices = std::move(new_indices);
-		return val;
+		return end;
+	}
+
+	size_t stable_partition_unflagged_indices(const std::vector<uint16_t>& flags, size_t begin, size_t length, std::vector<size_t>& indices)
+	{
+		return stable_partition_indices(flags, 0x00FF, begin, length, indices);
 	}
 
 	void HostParticleSnapshot::gather(const std::vector<size_t>& indices, size_t begin, size_t length)
 	{
-		sr::data::gather(r, indices, begin, length);
-		sr::data::gather(v, indices, begin, length);
-		sr::data::gather(id, indices, begin, length);
+		permute(indices, begin, length, r, v, id);
 	}
 
 	void HostParticleSnapshot::resize(size_t length)
@@ -78,16 +92,116 @@ namespace data
 
 	void HostParticlePhaseSpace::gather(const std::vector<size_t>& indices, size_t begin, size_t length)
 	{
-		base.gather(indices, begin, length);
-		sr::data::gather(deathtime(), indices, begin, length);
-		sr::data::gather(deathflags(), indices, begin, length);
-
 		if (deathtime_index().size() > 0)
 		{
-			sr::data::gather(deathtime_index(), indices, begin, length);
+			permute(indices, begin, length, r(), v(), id(), deathtime(), deathflags(), deathtime_index());
+		}
+		else
+		{
+			permute(indices, begin, length, r(), v(), id(), deathtime(), deathflags());
+		}
+
+		if (!_id_index.empty())
+		{
+			_id_index.update(id(), begin, length);
 		}
 	}
 
+	void HostParticlePhaseSpace::build_id_index()
+	{
+		_id_index.build(id(), n());
+	}
+
+	void ParticleIdIndex::build(const Vu32& id, size_t n)
+	{
+		uint32_t lo = n > 0 ? *std::min_element(id.begin(), id.begin() + static_cast<ptrdiff_t>(n)) : 0;
+		uint32_t hi = n > 0 ? *std::max_element(id.begin(), id.begin() + static_cast<ptrdiff_t>(n)) : 0;
+		size_t span = static_cast<size_t>(hi - lo) + 1;
+
+		Slot empty_slot = { EMPTY, EMPTY };
+
+		// A flat array wastes little memory as long as most of the IDs in the range are used
+		dense = span <= 4 * n + 64;
+		min_id = lo;
+
+		if (dense)
+		{
+			slots = std::vector<Slot>(span, empty_slot);
+		}
+		else
+		{
+			// At most half full, so that probe sequences stay short
+			size_t capacity = 2;
+			shift = 31;
+			while (capacity < 2 * n)
+			{
+				capacity *= 2;
+				shift--;
+			}
+
+			slots = std::vector<Slot>(capacity, empty_slot);
+			mask = capacity - 1;
+		}
+
+		for (size_t i = 0; i < n; i++)
+		{
+			Slot& slot = dense ? slots[id[i] - min_id] : slots[probe(id[i])];
+
+			if (slot.index != EMPTY)
+			{
+				std::ostringstream ss;
+				ss << "Error: particle ID " << id[i] << " appears more than once";
+				throw std::runtime_error(ss.str());
+			}
+
+			slot.id = id[i];
+			slot.index = static_cast<uint32_t>(i);
+		}
+	}
+
+	void ParticleIdIndex::update(const Vu32& id, size_t begin, size_t length)
+	{
+		for (size_t i = begin; i < begin + length; i++)
+		{
+			Slot& slot = dense ? slots[id[i] - min_id] : slots[probe(id[i])];
+			slot.index = static_cast<uint32_t>(i);
+		}
+	}
+
+	size_t ParticleIdIndex::at(uint32_t id) const
+	{
+		const Slot* slot = nullptr;
+
+		if (dense)
+		{
+			if (id >= min_id && id - min_id < slots.size()) slot = &slots[id - min_id];
+		}
+		else if (!slots.empty())
+		{
+			slot = &slots[probe(id)];
+		}
+
+		if (!slot || slot->index == EMPTY)
+		{
+			throw std::out_of_range("Particle ID not in index");
+		}
+
+		return slot->index;
+	}
+
+	size_t ParticleIdIndex::probe(uint32_t id) const
+	{
+		// Fibonacci hashing: the top bits of the product depend on all of the bits of the ID
+		size_t i = static_cast<size_t>(static_cast<uint32_t>(id * 2654435769u) >> shift);
+
+		while (slots[i].index != EMPTY && slots[i].id != id)
+		{
+			i = (i + 1) & mask;
+		}
+
+		return i;
+	}
+
 	void HostParticlePhaseSpace::filter(const std::vector<size_t>& filter, HostParticlePhaseSpace& out) const
 	{
 		base.filter(filter, out.base);
@@ -105,51 +219,95 @@ namespace data
 		}
 	}
 
-	std::unique_ptr<std::vector<size_t>> HostParticlePhaseSpace::stable_partition_unflagged(size_t begin, size_t length)
+	void HostParticlePhaseSpace::copy_for_output(const HostParticlePhaseSpace& source, size_t length)
+	{
+		base.n = length;
+		base.n_alive = std::min(source.base.n_alive, length);
+
+		base.r.x.assign(source.base.r.x.begin(), source.base.r.x.begin() + length);
+		base.r.y.assign(source.base.r.y.begin(), source.base.r.y.begin() + length);
+		base.r.z.assign(source.base.r.z.begin(), source.base.r.z.begin() + length);
+		base.v.x.assign(source.base.v.x.begin(), source.base.v.x.begin() + length);
+		base.v.y.assign(source.base.v.y.begin(), source.base.v.y.begin() + length);
+		base.v.z.assign(source.base.v.z.begin(), source.base.v.z.begin() + length);
+		base.id.assign(source.base.id.begin(), source.base.id.begin() + length);
+
+		_deathflags.assign(source._deathflags.begin(), source._deathflags.begin() + length);
+		_deathtime.assign(source._deathtime.begin(), source._deathtime.begin() + length);
+	}
+
+	void HostParticlePhaseSpace::stable_partition_unflagged(size_t begin, size_t length, std::vector<size_t>& indices)
 	{
-		std::unique_ptr<std::vector<size_t>> indices;
-		n_alive() = stable_partition_unflagged_indices(deathflags(), begin, length, &indices);
+		n_alive() = stable_partition_unflagged_indices(deathflags(), begin, length, indices);
 		
-		this->gather(*indices, begin, length);
+		this->gather(indices, begin, length);
+	}
+
+	std::unique_ptr<std::vector<size_t>> HostParticlePhaseSpace::stable_partition_unflagged(size_t begin, size_t length)
+	{
+		auto indices = std::make_unique<std::vector<size_t>>();
+		stable_partition_unflagged(begin, length, *indices);
 
 		return indices;
 	}
 
-	std::unique_ptr<std::vector<size_t>> HostParticlePhaseSpace::stable_partition_alive(size_t begin, size_t length)
+	void HostParticlePhaseSpace::stable_partition_alive(size_t begin, size_t length, std::vector<size_t>& indices)
 	{
-		std::unique_ptr<std::vector<size_t>> indices;
-		n_alive() = stable_partition_alive_indices(deathflags(), begin, length, &indices);
+		n_alive() = stable_partition_alive_indices(deathflags(), begin, length, indices);
 		
-		this->gather(*indices, begin, length);
+		this->gather(indices, begin, length);
+	}
+
+	std::unique_ptr<std::vector<size_t>> HostParticlePhaseSpace::stable_partition_alive(size_t begin, size_t length)
+	{
+		auto indices = std::make_unique<std::vector<size_t>>();
+		stable_partition_alive(begin, length, *indices);
 
 		return indices;
 	}
 
-	std::unique_ptr<std::vector<size_t>> HostParticleSnapshot::sort_by_id(size_t begin, size_t length)
+	namespace
 	{
-		auto new_indices = std::make_unique<std::vector<size_t>>(length);
+		std::unique_ptr<std::vector<size_t>> sort_by_id_indices(const Vu32& id, size_t begin, size_t length)
+		{
+			auto new_indices = std::make_unique<std::vector<size_t>>(length);
 
-		std::iota(new_indices->begin(), new_indices->end(), 0);
-		std::sort(new_indices->begin(), new_indices->end(), [begin, this](size_t a, size_t b)
-				{ return id[a + begin] < id[b + begin]; });
+			std::iota(new_indices->begin(), new_indices->end(), 0);
+			std::sort(new_indices->begin(), new_indices->end(), [begin, &id](size_t a, size_t b)
+					{ return id[a + begin] < id[b + begin]; });
 
-		this->gather(*new_indices, 0, length);
+			return new_indices;
+		}
+	}
+
+	std::unique_ptr<std::vector<size_t>> HostParticleSnapshot::sort_by_id(size_t begin, size_t length)
+	{
+		auto indices = sort_by_id_indices(id, begin, length);
 
-		return new_indices;
+		this->gather(*indices, begin, length);
+		return indices;
 	}
 
 	std::unique_ptr<std::vector<size_t>> HostParticlePhaseSpace::sort_by_id(size_t begin, size_t length)
 	{
-		auto indices = base.sort_by_id(begin, length);
+		auto indices = sort_by_id_indices(id(), begin, length);
 
-		this->gather(*indices, 0, length);
+		this->gather(*indices, begin, length);
 		return indices;
 	}
 
 	Configuration::Configuration()
 	{
-		num_thread = 4;
+		num_thread = 0;
+		cpu_chunk_size = 0;
+		cpu_planet_lookahead = 4;
+		cpu_particle_major = true;
+		cpu_fixed_kepler = false;
+		mixed_precision_ratio = 0;
+		cpu_isa = "auto";
 		max_kep = 10;
+		corrector_order = 0;
+		integrator = IntegratorType::WH;
 		t_0 = 0;
 		t_f = 365e4;
 		dt = 122;
@@ -162,10 +320,19 @@ namespace data
 		cull_radius = 0.5;
 
 		resync_every = 1;
+		resync_dead_fraction = 0;
+		adaptive_tbsize = false;
+		min_tbsize = 16;
+		cpu_tbsize = 0;
 		print_every = 10;
 		energy_every = 1;
 		track_every = 0;
 		split_track_file = 0;
+		writer_queue_size = 4;
+		drop_track_frames = false;
+		fork_dumps = false;
+		max_dump_processes = 2;
+		allocation_check_after = 0;
 
 		dump_every = 1000;
 		max_particle = static_cast<uint32_t>(-1);
@@ -222,18 +389,51 @@ namespace data
 					out->tbsize = std::stou(second);
 				else if (first == "Max-Kepler-Iterations")
 					out->max_kep = std::stou(second);
+				else if (first == "Symplectic-Corrector")
+					out->corrector_order = std::stou(second);
+				else if (first == "Integrator")
+				{
+					if (second == "WH")
+						out->integrator = IntegratorType::WH;
+					else if (second == "SIA4")
+						out->integrator = IntegratorType::SIA4;
+					else
+						throw std::invalid_argument("bad");
+				}
 				else if (first == "Big-G")
 					out->big_g = std::stod(second);
 				else if (first == "Cull-Radius")
 					out->cull_radius = std::stod(second);
 				else if (first == "CPU-Thread-Count")
 					out->num_thread = std::stou(second);
+				else if (first == "CPU-Chunk-Size")
+					out->cpu_chunk_size = std::stou(second);
+				else if (first == "CPU-Planet-Lookahead")
+					out->cpu_planet_lookahead = std::stou(second);
+				else if (first == "CPU-Particle-Major")
+					out->cpu_particle_major = std::stoi(second) != 0;
+				else if (first == "CPU-Fixed-Kepler")
+					out->cpu_fixed_kepler = std::stoi(second) != 0;
+				else if (first == "Mixed-Precision-Ratio")
+					out->mixed_precision_ratio = std::stod(second);
+				else if (first == "CPU-ISA")
+					out->cpu_isa = second;
 				else if (first == "Limit-Particle-Count")
 					out->max_particle = std::stou(second);
 				else if (first == "Log-Interval")
 					out->print_every = std::stou(second);
 				else if (first == "Resync-Interval")
 					out->resync_every = std::stou(second);
+				else if (first == "Resync-Dead-Fraction")
+					out->resync_dead_fraction = std::stod(second);
+				else if (first == "Adaptive-Time-Block")
+					out->adaptive_tbsize = std::stoi(second) != 0;
+				else if (first == "Min-Time-Block-Size")
+					out->min_tbsize = std::stou(second);
+				else if (first == "CPU-Time-Block-Size")
+					out->cpu_tbsize = std::stou(second);
+				else if (first == "Tuning-Cache")
+					out->tuning_cache = second;
 				else if (first == "Status-Interval")
 					out->energy_every = std::stou(second);
 				else if (first == "Track-Interval")
@@ -242,6 +442,16 @@ namespace data
 					out->write_bary_track = std::stoi(second) != 0;
 				else if (first == "Split-Track-File")
 					out->split_track_file = std::stou(second);
+				else if (first == "Writer-Queue-Size")
+					out->writer_queue_size = std::stou(second);
+				else if (first == "Drop-Track-Frames")
+					out->drop_track_frames = std::stoi(second) != 0;
+				else if (first == "Fork-Dumps")
+					out->fork_dumps = std::stoi(second) != 0;
+				else if (first == "Max-Dump-Processes")
+					out->max_dump_processes = std::stou(second);
+				else if (first == "Allocation-Check-After")
+					out->allocation_check_after = std::stou(second);
 				else if (first == "Dump-Interval")
 					out->dump_every = std::stou(second);
 				else if (first == "Write-Split-Output")
@@ -249,7 +459,7 @@ namespace data
 				else if (first == "Read-Split-Input")
 					out->readsplit = std::stoi(second) != 0;
 				else if (first == "Write-Binary-Output")
-					out->writebinary = std::stoi(second) != 0;
+					out->writebinary = std::stou(second);
 				else if (first == "Read-Binary-Input")
 					out->readbinary = std::stoi(second) != 0;
 				else if (first == "Input-File")
@@ -303,6 +513,50 @@ namespace data
 		{
 			throw std::runtime_error("Error: Read-Split-Input was selected but Particle-Input-File or Planet-Input-File were not specified");
 		}
+		if (out->corrector_order != 0 && out->corrector_order != 3 && out->corrector_order != 5 && out->corrector_order != 7)
+		{
+			throw std::runtime_error("Error: Symplectic-Corrector must be 0, 3, 5 or 7");
+		}
+		if (out->integrator != IntegratorType::WH && out->corrector_order != 0)
+		{
+			throw std::runtime_error("Error: Symplectic-Corrector is only supported by the WH integrator");
+		}
+		if (out->writer_queue_size == 0)
+		{
+			throw std::runtime_error("Error: Writer-Queue-Size must be at least 1");
+		}
+		if (out->max_dump_processes == 0)
+		{
+			throw std::runtime_error("Error: Max-Dump-Processes must be at least 1");
+		}
+		if (out->cpu_planet_lookahead == 0)
+		{
+			throw std::runtime_error("Error: CPU-Planet-Lookahead must be at least 1");
+		}
+		if (out->adaptive_tbsize && (out->min_tbsize == 0 || out->min_tbsize > out->tbsize))
+		{
+			throw std::runtime_error("Error: Min-Time-Block-Size must be between 1 and Time-Block-Size");
+		}
+		if (out->writebinary > 2)
+		{
+			throw std::runtime_error("Error: Write-Binary-Output must be 0, 1 or 2");
+		}
+		if (out->cpu_tbsize > out->tbsize)
+		{
+			throw std::runtime_error("Error: CPU-Time-Block-Size must be at most Time-Block-Size");
+		}
+		if (out->resync_dead_fraction < 0 || out->resync_dead_fraction > 1)
+		{
+			throw std::runtime_error("Error: Resync-Dead-Fraction must be between 0 and 1");
+		}
+		if (out->mixed_precision_ratio < 0 || (out->mixed_precision_ratio > 0 && out->mixed_precision_ratio < 1))
+		{
+			throw std::runtime_error("Error: Mixed-Precision-Ratio must be 0 or at least 1");
+		}
+		if (out->mixed_precision_ratio > 0 && (out->integrator != IntegratorType::WH || !out->cpu_particle_major))
+		{
+			throw std::runtime_error("Error: Mixed-Precision-Ratio is only supported by the particle-major engine of the WH integrator");
+		}
 	}
 
 	void write_configuration(std::ostream& outstream, const Configuration& out)
@@ -314,14 +568,32 @@ namespace data
 		outstream << "Time-Block-Size " << out.tbsize << std::endl;
 		outstream << "Cull-Radius " << out.cull_radius << std::endl;
 		outstream << "Max-Kepler-Iterations " << out.max_kep << std::endl;
+		outstream << "Symplectic-Corrector " << out.corrector_order << std::endl;
+		outstream << "Integrator " << (out.integrator == IntegratorType::SIA4 ? "SIA4" : "WH") << std::endl;
 		outstream << "CPU-Thread-Count " << out.num_thread << std::endl;
+		outstream << "CPU-Chunk-Size " << out.cpu_chunk_size << std::endl;
+		outstream << "CPU-Planet-Lookahead " << out.cpu_planet_lookahead << std::endl;
+		outstream << "CPU-Particle-Major " << out.cpu_particle_major << std::endl;
+		outstream << "CPU-Fixed-Kepler " << out.cpu_fixed_kepler << std::endl;
+		outstream << "Mixed-Precision-Ratio " << out.mixed_precision_ratio << std::endl;
+		outstream << "CPU-ISA " << out.cpu_isa << std::endl;
 		outstream << "Limit-Particle-Count " << out.max_particle << std::endl;
 		outstream << "Log-Interval " << out.print_every << std::endl;
 		outstream << "Status-Interval " << out.energy_every << std::endl;
 		outstream << "Track-Interval " << out.track_every << std::endl;
 		outstream << "Resync-Interval " << out.resync_every << std::endl;
+		outstream << "Resync-Dead-Fraction " << out.resync_dead_fraction << std::endl;
+		outstream << "Adaptive-Time-Block " << out.adaptive_tbsize << std::endl;
+		outstream << "Min-Time-Block-Size " << out.min_tbsize << std::endl;
+		outstream << "CPU-Time-Block-Size " << out.cpu_tbsize << std::endl;
+		outstream << "Tuning-Cache " << out.tuning_cache << std::endl;
 		outstream << "Write-Barycentric-Track " << out.write_bary_track << std::endl;
 		outstream << "Split-Track-File " << out.split_track_file << std::endl;
+		outstream << "Writer-Queue-Size " << out.writer_queue_size << std::endl;
+		outstream << "Drop-Track-Frames " << out.drop_track_frames << std::endl;
+		outstream << "Fork-Dumps " << out.fork_dumps << std::endl;
+		outstream << "Max-Dump-Processes " << out.max_dump_processes << std::endl;
+		outstream << "Allocation-Check-After " << out.allocation_check_after << std::endl;
 		outstream << "Dump-Interval " << out.dump_every << std::endl;
 		outstream << "Write-Split-Output " << out.writesplit << std::endl;
 		outstream << "Write-Binary-Output " << out.writebinary << std::endl;
@@ -355,138 +627,638 @@ namespace data
 		return false;
 	}
 
-	bool load_data_nohybrid(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config, std::istream& plin, std::istream& icsin)
+	namespace
 	{
-		load_planet_data(pl, config, plin);
+		using sr::util::TextCursor;
+		typedef TextCursor::Across Across;
 
-		size_t npart;
-		icsin >> npart;
-		npart = std::min(npart, static_cast<size_t>(config.max_particle));
+		/** The fewest particles that get a parsing thread of their own. */
+		const size_t PARSE_CHUNK_SIZE = 1 << 14;
 
-		pa = HostParticlePhaseSpace(npart);
+		inline void read_vector(TextCursor& in, double* x, double* y, double* z, size_t i, Across across)
+		{
+			x[i] = in.read_double(across);
+			y[i] = in.read_double(across);
+			z[i] = in.read_double(across);
+		}
 
-		for (size_t i = 0; i < npart; i++)
+		inline void read_vector(TextCursor& in, f64_3& v, Across across)
 		{
-			icsin >> pa.r()[i].x >> pa.r()[i].y >> pa.r()[i].z;
-			icsin >> pa.v()[i].x >> pa.v()[i].y >> pa.v()[i].z;
+			v.x = in.read_double(across);
+			v.y = in.read_double(across);
+			v.z = in.read_double(across);
+		}
 
-			std::string s;
-			icsin >> s;
-			if (!isdigit(s[0]))
+		/** A particle record of a state file is three lines: the position, the velocity, and the id, death flags and death time. */
+		void parse_hybrid_particles(TextCursor in, HostParticlePhaseSpace& pa, size_t begin, size_t end)
+		{
+			double* rx = pa.r().x.data();
+			double* ry = pa.r().y.data();
+			double* rz = pa.r().z.data();
+			double* vx = pa.v().x.data();
+			double* vy = pa.v().y.data();
+			double* vz = pa.v().z.data();
+
+			for (size_t i = begin; i < end; i++)
 			{
-				icsin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-				pa.deathtime()[i] = 0;
-				pa.id()[i] = static_cast<uint32_t>(i);
-				pa.deathflags()[i] = 0;
+				read_vector(in, rx, ry, rz, i, Across::None);
+				in.skip_line();
+				read_vector(in, vx, vy, vz, i, Across::None);
+				in.skip_line();
+
+				pa.id()[i] = static_cast<uint32_t>(in.read_unsigned(std::numeric_limits<uint32_t>::max(), Across::None));
+				pa.deathflags()[i] = static_cast<uint16_t>(in.read_unsigned(std::numeric_limits<uint16_t>::max(), Across::None));
+				pa.deathtime()[i] = in.read_float(Across::None);
+				in.skip_line();
+			}
+		}
+
+		void skip_hybrid_particle(TextCursor& in)
+		{
+			in.skip_line();
+			in.skip_line();
+			in.skip_line();
+		}
+
+		/**
+		 * A particle of a split particle file is a position and a velocity, optionally followed by the death time,
+		 * death flags and id. Anything else after the velocity is ignored up to the end of the line, and the particle
+		 * gets its index as its id.
+		 */
+		void parse_split_particles(TextCursor in, HostParticlePhaseSpace& pa, size_t begin, size_t end)
+		{
+			double* rx = pa.r().x.data();
+			double* ry = pa.r().y.data();
+			double* rz = pa.r().z.data();
+			double* vx = pa.v().x.data();
+			double* vy = pa.v().y.data();
+			double* vz = pa.v().z.data();
+
+			for (size_t i = begin; i < end; i++)
+			{
+				read_vector(in, rx, ry, rz, i, Across::Lines);
+				read_vector(in, vx, vy, vz, i, Across::Lines);
+
+				char c = in.peek(Across::Lines);
+				if (c < '0' || c > '9')
+				{
+					in.skip_token(Across::Lines);
+					in.skip_line();
+					pa.deathtime()[i] = 0;
+					pa.id()[i] = static_cast<uint32_t>(i);
+					pa.deathflags()[i] = 0;
+				}
+				else
+				{
+					pa.deathtime()[i] = in.read_float(Across::Lines);
+					pa.deathflags()[i] = static_cast<uint16_t>(in.read_unsigned(std::numeric_limits<uint16_t>::max(), Across::Lines));
+					pa.id()[i] = static_cast<uint32_t>(in.read_unsigned(std::numeric_limits<uint32_t>::max(), Across::Lines));
+				}
+			}
+		}
+
+		void skip_split_particle(TextCursor& in)
+		{
+			for (int j = 0; j < 6; j++)
+			{
+				in.skip_token(Across::Lines);
+			}
+
+			char c = in.peek(Across::Lines);
+			in.skip_token(Across::Lines);
+
+			if (c < '0' || c > '9')
+			{
+				in.skip_line();
 			}
 			else
 			{
-				pa.deathtime()[i] = std::stof(s);
-				icsin >> pa.deathflags()[i] >> pa.id()[i];
+				in.skip_token(Across::Lines);
+				in.skip_token(Across::Lines);
 			}
 		}
 
-		return false;
+		/**
+		 * Parses the particles on up to one thread per hardware thread, in contiguous ranges. The starts of the ranges
+		 * are found by skipping over the records first, which is much cheaper than converting the numbers in them.
+		 * If any range is malformed, the error of the first one in the file is thrown.
+		 */
+		void parse_particles_parallel(TextCursor in, HostParticlePhaseSpace& pa,
+				void (*parse)(TextCursor, HostParticlePhaseSpace&, size_t, size_t), void (*skip)(TextCursor&))
+		{
+			size_t n = pa.n();
+			size_t n_thread = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (n + PARSE_CHUNK_SIZE - 1) / PARSE_CHUNK_SIZE);
+			if (n_thread <= 1)
+			{
+				parse(in, pa, 0, n);
+				return;
+			}
+
+			std::vector<TextCursor> starts;
+			std::vector<size_t> bounds;
+			TextCursor scan = in;
+
+			for (size_t t = 0, i = 0; t < n_thread; t++)
+			{
+				size_t begin = n * t / n_thread;
+				for (; i < begin; i++)
+				{
+					skip(scan);
+				}
+
+				starts.push_back(scan);
+				bounds.push_back(begin);
+			}
+			bounds.push_back(n);
+
+			std::vector<std::exception_ptr> errors(n_thread);
+			auto run = [&](size_t t)
+			{
+				try
+				{
+					parse(starts[t], pa, bounds[t], bounds[t + 1]);
+				}
+				catch (...)
+				{
+					errors[t] = std::current_exception();
+				}
+			};
+
+			std::vector<std::thread> threads;
+			for (size_t t = 1; t < n_thread; t++)
+			{
+				threads.emplace_back(run, t);
+			}
+
+			run(0);
+
+			for (std::thread& thread : threads)
+			{
+				thread.join();
+			}
+
+			for (std::exception_ptr& error : errors)
+			{
+				if (error) std::rethrow_exception(error);
+			}
+		}
+
+		size_t read_count(TextCursor& in, const Configuration& config, Across across)
+		{
+			size_t n = static_cast<size_t>(in.read_unsigned(std::numeric_limits<size_t>::max(), across));
+			return std::min(n, static_cast<size_t>(config.max_particle));
+		}
+
+		void load_data_nohybrid(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config)
+		{
+			sr::util::MappedFile plfile(config.plin);
+			TextCursor plin(plfile.data(), plfile.data() + plfile.size(), &config.plin);
+
+			size_t npl = static_cast<size_t>(plin.read_unsigned(std::numeric_limits<size_t>::max(), Across::Lines));
+			pl = HostPlanetPhaseSpace(npl, config.tbsize);
+
+			for (size_t i = 0; i < npl; i++)
+			{
+				pl.m()[i] = plin.read_double(Across::Lines);
+				read_vector(plin, pl.r()[i], Across::Lines);
+				read_vector(plin, pl.v()[i], Across::Lines);
+
+				pl.id()[i] = static_cast<uint32_t>(i);
+			}
+
+			sr::util::MappedFile icsfile(config.icsin);
+			TextCursor icsin(icsfile.data(), icsfile.data() + icsfile.size(), &config.icsin);
+
+			pa = HostParticlePhaseSpace(read_count(icsin, config, Across::Lines));
+			parse_particles_parallel(icsin, pa, &parse_split_particles, &skip_split_particle);
+		}
+
+		void load_data_hybrid(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config)
+		{
+			sr::util::MappedFile file(config.hybridin);
+			TextCursor in(file.data(), file.data() + file.size(), &config.hybridin);
+
+			size_t npl = static_cast<size_t>(in.read_unsigned(std::numeric_limits<size_t>::max(), Across::None));
+			in.skip_line();
+			pl = HostPlanetPhaseSpace(npl, config.tbsize);
+
+			for (size_t i = 0; i < npl; i++)
+			{
+				pl.m()[i] = in.read_double(Across::None);
+				in.skip_line();
+				read_vector(in, pl.r()[i], Across::None);
+				in.skip_line();
+				read_vector(in, pl.v()[i], Across::None);
+				in.skip_line();
+				pl.id()[i] = static_cast<uint32_t>(in.read_unsigned(std::numeric_limits<uint32_t>::max(), Across::None));
+				in.skip_line();
+			}
+
+			pa = HostParticlePhaseSpace(read_count(in, config, Across::None));
+			in.skip_line();
+			parse_particles_parallel(in, pa, &parse_hybrid_particles, &skip_hybrid_particle);
+		}
 	}
 
-	bool load_data_hybrid(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config, std::istream& in)
+	namespace
 	{
-		std::string s;
+		/** The sizes of the packed records in a binary state file, see `save_data_hybrid_binary`. */
+		const size_t PLANET_RECORD_SIZE = sizeof(uint32_t) + 7 * sizeof(double);
+		const size_t PARTICLE_RECORD_SIZE = sizeof(uint32_t) + 6 * sizeof(double) + sizeof(uint16_t) + sizeof(float);
 
-		std::getline(in, s);
-		std::istringstream ss(s);
-		size_t npl;
-		ss >> npl;
-		
-		pl = HostPlanetPhaseSpace(npl, config.tbsize);
+		/** The fewest particles that get a decoding thread of their own. */
+		const size_t DECODE_CHUNK_SIZE = 1 << 16;
 
-		for (size_t i = 0; i < npl; i++)
+		/** Reads a value from an unaligned position in a little-endian file, reversing its bytes if `Swap` is set. */
+		template<bool Swap, typename T>
+		inline T decode(const char* p)
 		{
-			std::getline(in, s);
-			ss = std::istringstream(s);
-			ss >> pl.m()[i];
-
-			std::getline(in, s);
-			ss = std::istringstream(s);
-			ss >> pl.r()[i].x >> pl.r()[i].y >> pl.r()[i].z;
+			T t;
+			std::memcpy(&t, p, sizeof(T));
+			return Swap ? reverse_bytes(t) : t;
+		}
 
-			std::getline(in, s);
-			ss = std::istringstream(s);
-			ss >> pl.v()[i].x >> pl.v()[i].y >> pl.v()[i].z;
+		template<bool Swap>
+		inline void decode_vector(const char* p, f64_3& v)
+		{
+			v.x = decode<Swap, double>(p);
+			v.y = decode<Swap, double>(p + 8);
+			v.z = decode<Swap, double>(p + 16);
+		}
 
-			std::getline(in, s);
-			ss = std::istringstream(s);
-			
-			ss >> pl.id()[i];
+		template<bool Swap>
+		void decode_planets(const char* records, HostPlanetPhaseSpace& pl)
+		{
+			for (size_t i = 0; i < pl.n(); i++)
+			{
+				const char* p = records + i * PLANET_RECORD_SIZE;
+				pl.id()[i] = decode<Swap, uint32_t>(p);
+				pl.m()[i] = decode<Swap, double>(p + 4);
+				decode_vector<Swap>(p + 12, pl.r()[i]);
+				decode_vector<Swap>(p + 36, pl.v()[i]);
+			}
 		}
 
-		std::getline(in, s);
-		ss = std::istringstream(s);
-		size_t npart;
-		ss >> npart;
-		npart = std::min(npart, static_cast<size_t>(config.max_particle));
-		pa = HostParticlePhaseSpace(npart);
+		template<bool Swap>
+		void decode_particles(const char* records, HostParticlePhaseSpace& pa, size_t begin, size_t end)
+		{
+			// Straight into the columns, so that the loop is plain loads and stores at fixed offsets
+			uint32_t* id = pa.id().data();
+			double* rx = pa.r().x.data();
+			double* ry = pa.r().y.data();
+			double* rz = pa.r().z.data();
+			double* vx = pa.v().x.data();
+			double* vy = pa.v().y.data();
+			double* vz = pa.v().z.data();
+			uint16_t* deathflags = pa.deathflags().data();
+			float* deathtime = pa.deathtime().data();
+
+			for (size_t i = begin; i < end; i++)
+			{
+				const char* p = records + i * PARTICLE_RECORD_SIZE;
+				id[i] = decode<Swap, uint32_t>(p);
+				rx[i] = decode<Swap, double>(p + 4);
+				ry[i] = decode<Swap, double>(p + 12);
+				rz[i] = decode<Swap, double>(p + 20);
+				vx[i] = decode<Swap, double>(p + 28);
+				vy[i] = decode<Swap, double>(p + 36);
+				vz[i] = decode<Swap, double>(p + 44);
+				deathflags[i] = decode<Swap, uint16_t>(p + 52);
+				deathtime[i] = decode<Swap, float>(p + 54);
+			}
+		}
 
-		for (size_t i = 0; i < npart; i++)
+		/** Decodes the particle records on up to one thread per hardware thread, in contiguous ranges. */
+		template<bool Swap>
+		void decode_particles_parallel(const char* records, HostParticlePhaseSpace& pa)
 		{
-			std::getline(in, s);
-			ss = std::istringstream(s);
-			ss >> pa.r()[i].x >> pa.r()[i].y >> pa.r()[i].z;
+			size_t n = pa.n();
+			size_t n_thread = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), (n + DECODE_CHUNK_SIZE - 1) / DECODE_CHUNK_SIZE);
+			if (n_thread <= 1)
+			{
+				decode_particles<Swap>(records, pa, 0, n);
+				return;
+			}
+
+			std::vector<std::thread> threads;
+			for (size_t t = 1; t < n_thread; t++)
+			{
+				threads.emplace_back(&decode_particles<Swap>, records, std::ref(pa), n * t / n_thread, n * (t + 1) / n_thread);
+			}
 
-			std::getline(in, s);
-			ss = std::istringstream(s);
-			ss >> pa.v()[i].x >> pa.v()[i].y >> pa.v()[i].z;
+			decode_particles<Swap>(records, pa, 0, n / n_thread);
 
-			std::getline(in, s);
-			ss = std::istringstream(s);
-			ss >> pa.id()[i] >> pa.deathflags()[i] >> pa.deathtime()[i];
+			for (std::thread& thread : threads)
+			{
+				thread.join();
+			}
 		}
+	}
+
+	bool load_data_hybrid_binary(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config, const char* data, size_t size)
+	{
+		// The byte order is checked once for the whole file rather than per value
+		bool swap = !is_int_little_endian() || !is_float_little_endian() || !is_double_little_endian();
+		size_t offset = 0;
+
+		if (size < offset + sizeof(uint64_t)) return true;
+		uint64_t npl = swap ? decode<true, uint64_t>(data) : decode<false, uint64_t>(data);
+		offset += sizeof(uint64_t);
+
+		if (npl > (size - offset) / PLANET_RECORD_SIZE) return true;
+		pl = HostPlanetPhaseSpace(static_cast<size_t>(npl), config.tbsize);
+
+		if (swap) decode_planets<true>(data + offset, pl);
+		else decode_planets<false>(data + offset, pl);
+		offset += pl.n() * PLANET_RECORD_SIZE;
+
+		if (size < offset + sizeof(uint64_t)) return true;
+		uint64_t npart = swap ? decode<true, uint64_t>(data + offset) : decode<false, uint64_t>(data + offset);
+		offset += sizeof(uint64_t);
+
+		npart = std::min(npart, static_cast<uint64_t>(config.max_particle));
+		if (npart > (size - offset) / PARTICLE_RECORD_SIZE) return true;
+		pa = HostParticlePhaseSpace(static_cast<size_t>(npart));
+
+		if (swap) decode_particles_parallel<true>(data + offset, pa);
+		else decode_particles_parallel<false>(data + offset, pa);
 
 		return false;
 	}
 
-	bool load_data_hybrid_binary(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config, std::istream& in)
+	namespace
 	{
-		uint64_t templl;
-		read_binary<uint64_t>(in, templl);
-		size_t npl = static_cast<size_t>(templl);
-		pl = HostPlanetPhaseSpace(npl, config.tbsize);
+		const char STATE_MAGIC[8] = { 'G', 'L', 'I', 'S', 'S', 'E', 'S', 'T' };
+		const uint32_t STATE_VERSION = 1;
+		const uint32_t STATE_BYTE_ORDER = 0x01020304;
+
+		/** The header of a columnar state file is followed by the column directory, and the columns start on this alignment. */
+		const size_t STATE_HEADER_SIZE = 64;
+		const size_t STATE_ENTRY_SIZE = 32;
+		const size_t STATE_ALIGNMENT = 64;
+
+		const uint32_t STATE_FLAG_MOMENTA = 0x01;
+		const uint32_t STATE_FLAG_BARYCENTRIC = 0x02;
+
+		/** The IDs of the columns in the directory. Readers skip the IDs they do not know. */
+		const uint32_t COLUMN_PLANET_ID = 0;
+		const uint32_t COLUMN_PLANET_M = 1;
+		const uint32_t COLUMN_PLANET_R = 2;
+		const uint32_t COLUMN_PLANET_V = 5;
+		const uint32_t COLUMN_ID = 16;
+		const uint32_t COLUMN_R = 17;
+		const uint32_t COLUMN_V = 20;
+		const uint32_t COLUMN_DEATHFLAGS = 23;
+		const uint32_t COLUMN_DEATHTIME = 24;
+
+		/**
+		 * A checksum of a range of a column: FNV-1a over the bytes taken as little-endian 64-bit words, with the last partial word
+		 * zero-padded. It only depends on the bytes, so a file can be checked on a host of either byte order.
+		 */
+		uint64_t state_checksum(const char* data, size_t size)
+		{
+			const uint64_t PRIME = 0x100000001b3ULL;
+			uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+
+			size_t words = size / sizeof(uint64_t);
+			for (size_t i = 0; i < words; i++)
+			{
+				uint64_t word;
+				std::memcpy(&word, data + i * sizeof(uint64_t), sizeof(uint64_t));
+				hash = (hash ^ to_little_endian(word)) * PRIME;
+			}
+
+			if (size % sizeof(uint64_t) != 0)
+			{
+				uint64_t word = 0;
+				std::memcpy(&word, data + words * sizeof(uint64_t), size % sizeof(uint64_t));
+				hash = (hash ^ to_little_endian(word)) * PRIME;
+			}
 
-		for (size_t i = 0; i < pl.n(); i++)
+			return hash;
+		}
+
+		inline size_t align_state_offset(size_t offset)
 		{
-			read_binary<uint32_t>(in, pl.id()[i]);
-			read_binary<double>(in, pl.m()[i]);
-			read_binary<double>(in, pl.r()[i].x);
-			read_binary<double>(in, pl.r()[i].y);
-			read_binary<double>(in, pl.r()[i].z);
-			read_binary<double>(in, pl.v()[i].x);
-			read_binary<double>(in, pl.v()[i].y);
-			read_binary<double>(in, pl.v()[i].z);
+			return (offset + STATE_ALIGNMENT - 1) / STATE_ALIGNMENT * STATE_ALIGNMENT;
 		}
 
-		read_binary<uint64_t>(in, templl);
-		size_t npart = std::min(static_cast<size_t>(templl), static_cast<size_t>(config.max_particle));
-		pa = HostParticlePhaseSpace(npart);
+		inline bool has_state_magic(const char* data, size_t size)
+		{
+			return size >= sizeof(STATE_MAGIC) && std::memcmp(data, STATE_MAGIC, sizeof(STATE_MAGIC)) == 0;
+		}
 
-		for (size_t i = 0; i < pa.n(); i++)
+		template<typename T>
+		inline T decode_state(const char* p, bool swap)
 		{
-			read_binary<uint32_t>(in, pa.id()[i]);
-			read_binary<double>(in, pa.r()[i].x);
-			read_binary<double>(in, pa.r()[i].y);
-			read_binary<double>(in, pa.r()[i].z);
-			read_binary<double>(in, pa.v()[i].x);
-			read_binary<double>(in, pa.v()[i].y);
-			read_binary<double>(in, pa.v()[i].z);
-			read_binary<uint16_t>(in, pa.deathflags()[i]);
-			read_binary<float>(in, pa.deathtime()[i]);
+			return swap ? decode<true, T>(p) : decode<false, T>(p);
 		}
 
-		return !in;
+		/** Reads the columns of a mapped columnar state file, see `save_data_columnar`. */
+		class StateReader
+		{
+		public:
+			/** Reads the header and the column directory. Throws if they are not valid. */
+			StateReader(const char* _data, size_t _size, const std::string& _path) : data(_data), size(_size), path(_path)
+			{
+				if (!has_state_magic(data, size) || size < STATE_HEADER_SIZE) fail("is not a columnar state file");
+
+				uint32_t byte_order = decode<false, uint32_t>(data + 12);
+				if (byte_order == STATE_BYTE_ORDER) header.swapped = false;
+				else if (byte_order == reverse_bytes(STATE_BYTE_ORDER)) header.swapped = true;
+				else fail("has an unknown byte order");
+
+				bool swap = header.swapped;
+				header.version = decode_state<uint32_t>(data + 8, swap);
+				if (header.version != STATE_VERSION)
+				{
+					std::ostringstream ss;
+					ss << "has unsupported format version " << header.version;
+					fail(ss.str());
+				}
+
+				header.planet_count = decode_state<uint64_t>(data + 16, swap);
+				header.particle_count = decode_state<uint64_t>(data + 24, swap);
+				header.alive_count = decode_state<uint64_t>(data + 32, swap);
+				header.time = decode_state<double>(data + 40, swap);
+
+				uint32_t flags = decode_state<uint32_t>(data + 48, swap);
+				header.momenta = (flags & STATE_FLAG_MOMENTA) != 0;
+				header.barycentric = (flags & STATE_FLAG_BARYCENTRIC) != 0;
+
+				uint32_t column_count = decode_state<uint32_t>(data + 52, swap);
+				if (header.alive_count > header.particle_count) fail("has more alive particles than particles");
+				if (column_count > (size - STATE_HEADER_SIZE) / STATE_ENTRY_SIZE) fail("is truncated");
+
+				for (size_t i = 0; i < column_count; i++)
+				{
+					const char* p = data + STATE_HEADER_SIZE + i * STATE_ENTRY_SIZE;
+
+					Entry entry;
+					entry.id = decode_state<uint32_t>(p, swap);
+					entry.element_size = decode_state<uint32_t>(p + 4, swap);
+					entry.offset = decode_state<uint64_t>(p + 8, swap);
+					entry.checksum_alive = decode_state<uint64_t>(p + 16, swap);
+					entry.checksum_rest = decode_state<uint64_t>(p + 24, swap);
+					entries.push_back(entry);
+				}
+			}
+
+			/**
+			 * Copies the first `count` elements of a column of `total` elements to `out`, in the host byte order.
+			 * The column has separate checksums for its first `split` elements and for the rest; the first is always
+			 * verified, and the second unless `alive_only` is set, in which case `count` must be at most `split`.
+			 */
+			template<typename T>
+			void read(uint32_t id, const char* name, size_t total, size_t split, bool alive_only, T* out, size_t count) const
+			{
+				auto entry = std::find_if(entries.begin(), entries.end(), [id](const Entry& e) { return e.id == id; });
+				if (entry == entries.end()) fail(std::string("has no column ") + name);
+				if (entry->element_size != sizeof(T)) fail(std::string("has the wrong element size in column ") + name);
+				if (entry->offset > size || total > (size - entry->offset) / sizeof(T)) fail("is truncated");
+
+				const char* column = data + entry->offset;
+				if (state_checksum(column, split * sizeof(T)) != entry->checksum_alive
+					|| (!alive_only && state_checksum(column + split * sizeof(T), (total - split) * sizeof(T)) != entry->checksum_rest))
+				{
+					fail(std::string("has a checksum mismatch in column ") + name);
+				}
+
+				std::memcpy(out, column, count * sizeof(T));
+
+				if (header.swapped)
+				{
+					for (size_t i = 0; i < count; i++)
+					{
+						out[i] = reverse_bytes(out[i]);
+					}
+				}
+			}
+
+			/** Reads the three columns that start at `id` into the planet vectors `out`. */
+			void read_planet_vectors(uint32_t id, const char* name, size_t count, Vf64_3& out) const
+			{
+				std::vector<double> x(count), y(count), z(count);
+				read(id, name, count, count, false, x.data(), count);
+				read(id + 1, name, count, count, false, y.data(), count);
+				read(id + 2, name, count, count, false, z.data(), count);
+
+				for (size_t i = 0; i < count; i++)
+				{
+					out[i].x = x[i];
+					out[i].y = y[i];
+					out[i].z = z[i];
+				}
+			}
+
+			StateHeader header;
+
+		private:
+			struct Entry
+			{
+				uint32_t id, element_size;
+				uint64_t offset, checksum_alive, checksum_rest;
+			};
+
+			const char* data;
+			size_t size;
+			std::string path;
+			std::vector<Entry> entries;
+
+			[[noreturn]] void fail(const std::string& what) const
+			{
+				throw std::runtime_error("State file " + path + " " + what);
+			}
+		};
+
+		void load_columnar_state(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config,
+				const sr::util::MappedFile& in, uint32_t columns, bool alive_only, StateHeader* header)
+		{
+			StateReader reader(in.data(), in.size(), config.hybridin);
+			const StateHeader& h = reader.header;
+
+			size_t npl = static_cast<size_t>(h.planet_count);
+			pl = HostPlanetPhaseSpace(npl, config.tbsize);
+
+			reader.read(COLUMN_PLANET_ID, "planet id", npl, npl, false, pl.id().data(), npl);
+			reader.read(COLUMN_PLANET_M, "planet m", npl, npl, false, pl.m().data(), npl);
+			reader.read_planet_vectors(COLUMN_PLANET_R, "planet r", npl, pl.r());
+			reader.read_planet_vectors(COLUMN_PLANET_V, "planet v", npl, pl.v());
+
+			size_t total = static_cast<size_t>(h.particle_count);
+			size_t split = static_cast<size_t>(h.alive_count);
+			size_t npart = std::min(alive_only ? split : total, static_cast<size_t>(config.max_particle));
+			pa = HostParticlePhaseSpace(npart);
+
+			if (columns & state_column::ID)
+			{
+				reader.read(COLUMN_ID, "id", total, split, alive_only, pa.id().data(), npart);
+			}
+			if (columns & state_column::R)
+			{
+				reader.read(COLUMN_R, "r.x", total, split, alive_only, pa.r().x.data(), npart);
+				reader.read(COLUMN_R + 1, "r.y", total, split, alive_only, pa.r().y.data(), npart);
+				reader.read(COLUMN_R + 2, "r.z", total, split, alive_only, pa.r().z.data(), npart);
+			}
+			if (columns & state_column::V)
+			{
+				reader.read(COLUMN_V, "v.x", total, split, alive_only, pa.v().x.data(), npart);
+				reader.read(COLUMN_V + 1, "v.y", total, split, alive_only, pa.v().y.data(), npart);
+				reader.read(COLUMN_V + 2, "v.z", total, split, alive_only, pa.v().z.data(), npart);
+			}
+			if (columns & state_column::DEATHFLAGS)
+			{
+				reader.read(COLUMN_DEATHFLAGS, "deathflags", total, split, alive_only, pa.deathflags().data(), npart);
+			}
+			if (columns & state_column::DEATHTIME)
+			{
+				reader.read(COLUMN_DEATHTIME, "deathtime", total, split, alive_only, pa.deathtime().data(), npart);
+			}
+
+			if (header) *header = h;
+		}
+
+		/** Applies the input options that are common to all formats, and moves the alive particles to the front. */
+		void finish_load(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config, bool momenta)
+		{
+			for (size_t i = 0; i < pl.n(); i++)
+			{
+				if (momenta)
+				{
+					pl.v()[i] /= pl.m()[i];
+				}
+
+				pl.m()[i] *= config.big_g;
+			}
+
+			pa.stable_partition_alive(0, pa.n());
+		}
+	}
+
+	bool is_columnar_state(const std::string& path)
+	{
+		char magic[sizeof(STATE_MAGIC)];
+		std::ifstream in(path, std::ios_base::binary);
+		in.read(magic, sizeof(magic));
+
+		return in && has_state_magic(magic, sizeof(magic));
 	}
 
-	bool load_data(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config)
+	void load_data_columnar(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config, uint32_t columns, bool alive_only, StateHeader* header)
+	{
+		sr::util::MappedFile in(config.hybridin);
+
+		StateHeader h;
+		load_columnar_state(pl, pa, config, in, columns, alive_only, &h);
+		finish_load(pl, pa, config, h.momenta);
+
+		if (header) *header = h;
+	}
+
+	bool load_data(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config, double* time)
 	{
 		bool ret;
+		bool momenta = config.readmomenta;
 		if (config.readsplit)
 		{
 			if (!sr::util::does_file_exist(config.plin))
@@ -502,8 +1274,8 @@ namespace data
 				throw std::runtime_error(ss.str());
 			}
 			
-			std::ifstream plinfile(config.plin), icsinfile(config.icsin);
-			ret = load_data_nohybrid(pl, pa, config, plinfile, icsinfile);
+			load_data_nohybrid(pl, pa, config);
+			ret = false;
 		}
 		else
 		{
@@ -516,29 +1288,33 @@ namespace data
 
 			if (config.readbinary)
 			{
-				std::ifstream in(config.hybridin, std::ios_base::binary);
-				ret = load_data_hybrid_binary(pl, pa, config, in);
+				sr::util::MappedFile in(config.hybridin);
+
+				if (has_state_magic(in.data(), in.size()))
+				{
+					// The columnar format records whether it holds momenta, and the time
+					StateHeader header;
+					load_columnar_state(pl, pa, config, in, state_column::ALL, false, &header);
+
+					momenta = header.momenta;
+					if (time) *time = header.time;
+					ret = false;
+				}
+				else
+				{
+					ret = load_data_hybrid_binary(pl, pa, config, in.data(), in.size());
+				}
 			}
 			else
 			{
-				std::ifstream in(config.hybridin);
-				ret = load_data_hybrid(pl, pa, config, in);
+				load_data_hybrid(pl, pa, config);
+				ret = false;
 			}
 		}
 
 		if (!ret)
 		{
-			for (size_t i = 0; i < pl.n(); i++)
-			{
-				if (config.readmomenta)
-				{
-					pl.v()[i] /= pl.m()[i];
-				}
-
-				pl.m()[i] *= config.big_g;
-			}
-
-			pa.stable_partition_alive(0, pa.n());
+			finish_load(pl, pa, config, momenta);
 		}
 
 		return ret;
@@ -578,87 +1354,280 @@ namespace data
 		}
 	}
 
-	void save_data_hybrid(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, const Configuration& config, std::ostream& out)
+	/**
+	 * Saves a state in the columnar binary format: a 64-byte header, a directory with an entry per column,
+	 * and a block per column, aligned to 64 bytes. Each column has one checksum for the alive particles at the start
+	 * and one for the rest, so that either part can be loaded and verified alone.
+	 * The file is in the host byte order, which the header records.
+	 */
+	void save_data_columnar(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, const Configuration& config, std::ostream& out, double time)
 	{
-		(void) config;
-		out << pl.n_alive << std::endl;
-		out << std::setprecision(17);
-		for (size_t i = 0; i < pl.n_alive; i++)
+		struct Column
 		{
-			double m = pl.m[i];
-			out << m << std::endl;
-			if (!config.writemomenta) m = 1;
-			out << pl.r[i].x << " " << pl.r[i].y << " " << pl.r[i].z << std::endl;
-			out << pl.v[i].x * m << " " << pl.v[i].y * m << " " << pl.v[i].z * m << std::endl;
-			out << pl.id[i] << std::endl;
+			uint32_t id, element_size;
+			const void* data;
+			size_t count, split;
+		};
+
+		size_t npl = pl.n_alive;
+		std::vector<double> planet_columns[6];
+		for (auto& column : planet_columns) column.resize(npl);
+
+		for (size_t i = 0; i < npl; i++)
+		{
+			double m = config.writemomenta ? pl.m[i] : 1;
+			planet_columns[0][i] = pl.r[i].x;
+			planet_columns[1][i] = pl.r[i].y;
+			planet_columns[2][i] = pl.r[i].z;
+			planet_columns[3][i] = pl.v[i].x * m;
+			planet_columns[4][i] = pl.v[i].y * m;
+			planet_columns[5][i] = pl.v[i].z * m;
 		}
 
-		out << pa.n() << std::endl;
-		out << std::setprecision(17);
-		for (size_t i = 0; i < pa.n(); i++)
+		// The alive particles are the leading ones that load_data would keep in the integration
+		size_t n = pa.n();
+		size_t alive = 0;
+		while (alive < n && (pa.deathflags()[alive] & 0x00FE) == 0) alive++;
+
+		const Column columns[] =
+		{
+			{ COLUMN_PLANET_ID, sizeof(uint32_t), pl.id.data(), npl, npl },
+			{ COLUMN_PLANET_M, sizeof(double), pl.m.data(), npl, npl },
+			{ COLUMN_PLANET_R, sizeof(double), planet_columns[0].data(), npl, npl },
+			{ COLUMN_PLANET_R + 1, sizeof(double), planet_columns[1].data(), npl, npl },
+			{ COLUMN_PLANET_R + 2, sizeof(double), planet_columns[2].data(), npl, npl },
+			{ COLUMN_PLANET_V, sizeof(double), planet_columns[3].data(), npl, npl },
+			{ COLUMN_PLANET_V + 1, sizeof(double), planet_columns[4].data(), npl, npl },
+			{ COLUMN_PLANET_V + 2, sizeof(double), planet_columns[5].data(), npl, npl },
+			{ COLUMN_ID, sizeof(uint32_t), pa.id().data(), n, alive },
+			{ COLUMN_R, sizeof(double), pa.r().x.data(), n, alive },
+			{ COLUMN_R + 1, sizeof(double), pa.r().y.data(), n, alive },
+			{ COLUMN_R + 2, sizeof(double), pa.r().z.data(), n, alive },
+			{ COLUMN_V, sizeof(double), pa.v().x.data(), n, alive },
+			{ COLUMN_V + 1, sizeof(double), pa.v().y.data(), n, alive },
+			{ COLUMN_V + 2, sizeof(double), pa.v().z.data(), n, alive },
+			{ COLUMN_DEATHFLAGS, sizeof(uint16_t), pa.deathflags().data(), n, alive },
+			{ COLUMN_DEATHTIME, sizeof(float), pa.deathtime().data(), n, alive }
+		};
+		const size_t column_count = sizeof(columns) / sizeof(columns[0]);
+
+		// The sun sits at the origin in heliocentric coordinates
+		bool barycentric = npl > 0 && !(pl.r[0].lensq() < 1e-13 && pl.v[0].lensq() < 1e-13);
+		uint32_t flags = (config.writemomenta ? STATE_FLAG_MOMENTA : 0) | (barycentric ? STATE_FLAG_BARYCENTRIC : 0);
+
+		std::vector<char> header(STATE_HEADER_SIZE + column_count * STATE_ENTRY_SIZE);
+		auto put = [&header](size_t offset, const void* value, size_t value_size) { std::memcpy(header.data() + offset, value, value_size); };
+
+		uint64_t planet_count = npl, particle_count = n, alive_count = alive;
+		uint32_t column_count32 = static_cast<uint32_t>(column_count);
+		put(0, STATE_MAGIC, sizeof(STATE_MAGIC));
+		put(8, &STATE_VERSION, sizeof(uint32_t));
+		put(12, &STATE_BYTE_ORDER, sizeof(uint32_t));
+		put(16, &planet_count, sizeof(uint64_t));
+		put(24, &particle_count, sizeof(uint64_t));
+		put(32, &alive_count, sizeof(uint64_t));
+		put(40, &time, sizeof(double));
+		put(48, &flags, sizeof(uint32_t));
+		put(52, &column_count32, sizeof(uint32_t));
+
+		uint64_t offset = align_state_offset(header.size());
+		for (size_t i = 0; i < column_count; i++)
 		{
-			out << pa.r()[i].x << " " << pa.r()[i].y << " " << pa.r()[i].z << std::endl;
-			out << pa.v()[i].x << " " << pa.v()[i].y << " " << pa.v()[i].z << std::endl;
-			out << pa.id()[i] << " " << pa.deathflags()[i] << " " << pa.deathtime()[i] << std::endl;
+			const Column& column = columns[i];
+			const char* bytes = static_cast<const char*>(column.data);
+			uint64_t checksum_alive = state_checksum(bytes, column.split * column.element_size);
+			uint64_t checksum_rest = state_checksum(bytes + column.split * column.element_size, (column.count - column.split) * column.element_size);
+
+			size_t entry = STATE_HEADER_SIZE + i * STATE_ENTRY_SIZE;
+			put(entry, &column.id, sizeof(uint32_t));
+			put(entry + 4, &column.element_size, sizeof(uint32_t));
+			put(entry + 8, &offset, sizeof(uint64_t));
+			put(entry + 16, &checksum_alive, sizeof(uint64_t));
+			put(entry + 24, &checksum_rest, sizeof(uint64_t));
+
+			offset = align_state_offset(offset + column.count * column.element_size);
+		}
+
+		out.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+		const char padding[STATE_ALIGNMENT] = { };
+		size_t written = header.size();
+		for (const Column& column : columns)
+		{
+			out.write(padding, static_cast<std::streamsize>(align_state_offset(written) - written));
+
+			size_t column_size = column.count * column.element_size;
+			out.write(static_cast<const char*>(column.data), static_cast<std::streamsize>(column_size));
+			written = align_state_offset(written) + column_size;
 		}
 	}
 
-	void save_data_nohybrid(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, const Configuration& config, std::ostream& plout, std::ostream& icsout)
+	namespace
 	{
-		(void) config;
-		plout << pl.n_alive << std::endl;
-		plout << std::setprecision(17);
-		for (size_t i = 0; i < pl.n_alive; i++)
+		using sr::util::TextBuffer;
+
+		/** The particles that each thread formats at a time when writing a text state. */
+		const size_t FORMAT_CHUNK_SIZE = 1 << 14;
+
+		typedef void (*ParticleFormatter)(TextBuffer&, const HostParticlePhaseSpace&, size_t, size_t);
+
+		inline void append_vector(TextBuffer& out, double x, double y, double z)
 		{
-			double m = pl.m[i];
-			plout << m << std::endl;
+			out.append(x);
+			out.append(' ');
+			out.append(y);
+			out.append(' ');
+			out.append(z);
+			out.append('\n');
+		}
 
-			if (!config.writemomenta) m = 1;
-			plout << pl.r[i].x << " " << pl.r[i].y << " " << pl.r[i].z << std::endl;
-			plout << pl.v[i].x * m << " " << pl.v[i].y * m << " " << pl.v[i].z * m << std::endl;
+		inline void append_count(TextBuffer& out, size_t n)
+		{
+			out.append_unsigned(n);
+			out.append('\n');
 		}
 
-		icsout << pa.n() << std::endl;
-		icsout << std::setprecision(17);
-		for (size_t i = 0; i < pa.n(); i++)
+		/**
+		 * Writes the planets of a text state: the count, then the mass, position and velocity of each planet on lines of their own,
+		 * followed by the id if `ids` is set. The velocities are multiplied by the masses if `momenta` is set.
+		 */
+		void write_planets(std::ostream& out, const HostPlanetSnapshot& pl, bool momenta, bool ids)
+		{
+			TextBuffer buffer;
+			append_count(buffer, pl.n_alive);
+
+			for (size_t i = 0; i < pl.n_alive; i++)
+			{
+				double m = pl.m[i];
+				buffer.append(m);
+				buffer.append('\n');
+
+				if (!momenta) m = 1;
+				append_vector(buffer, pl.r[i].x, pl.r[i].y, pl.r[i].z);
+				append_vector(buffer, pl.v[i].x * m, pl.v[i].y * m, pl.v[i].z * m);
+
+				if (ids)
+				{
+					append_count(buffer, pl.id[i]);
+				}
+			}
+
+			buffer.write_to(out);
+		}
+
+		void format_hybrid_particles(TextBuffer& out, const HostParticlePhaseSpace& pa, size_t begin, size_t end)
 		{
-			icsout << pa.r()[i].x << " " << pa.r()[i].y << " " << pa.r()[i].z << std::endl;
-			icsout << pa.v()[i].x << " " << pa.v()[i].y << " " << pa.v()[i].z << std::endl;
-			icsout << pa.deathtime()[i] << " " << pa.deathflags()[i] << " " << pa.id()[i] << std::endl;
+			for (size_t i = begin; i < end; i++)
+			{
+				append_vector(out, pa.r().x[i], pa.r().y[i], pa.r().z[i]);
+				append_vector(out, pa.v().x[i], pa.v().y[i], pa.v().z[i]);
+
+				out.append_unsigned(pa.id()[i]);
+				out.append(' ');
+				out.append_unsigned(pa.deathflags()[i]);
+				out.append(' ');
+				out.append(pa.deathtime()[i]);
+				out.append('\n');
+			}
 		}
-	}
 
-	void save_data_swift(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, std::ostream& plout, std::ostream& icsout)
-	{
-		plout << pl.n_alive << std::endl;
-		plout << std::setprecision(17);
-		for (size_t i = 0; i < pl.n_alive; i++)
+		void format_split_particles(TextBuffer& out, const HostParticlePhaseSpace& pa, size_t begin, size_t end)
 		{
-			double m = pl.m[i];
-			plout << m << std::endl;
+			for (size_t i = begin; i < end; i++)
+			{
+				append_vector(out, pa.r().x[i], pa.r().y[i], pa.r().z[i]);
+				append_vector(out, pa.v().x[i], pa.v().y[i], pa.v().z[i]);
+
+				out.append(pa.deathtime()[i]);
+				out.append(' ');
+				out.append_unsigned(pa.deathflags()[i]);
+				out.append(' ');
+				out.append_unsigned(pa.id()[i]);
+				out.append('\n');
+			}
+		}
 
-			plout << pl.r[i].x << " " << pl.r[i].y << " " << pl.r[i].z << std::endl;
-			plout << pl.v[i].x << " " << pl.v[i].y << " " << pl.v[i].z << std::endl;
+		void format_swift_particles(TextBuffer& out, const HostParticlePhaseSpace& pa, size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				append_vector(out, pa.r().x[i], pa.r().y[i], pa.r().z[i]);
+				append_vector(out, pa.v().x[i], pa.v().y[i], pa.v().z[i]);
+				out.append("0 0 0 0 0 0 0 0 0 0 0 0 0\n0.0 0.0 0.0 0.0 0.0\n0.0 0.0 0.0 0.0 0.0\n0.0 0.0 0.0\n");
+			}
 		}
 
-		icsout << pa.n() << std::endl;
-		icsout << std::setprecision(17);
-		for (size_t i = 0; i < pa.n(); i++)
+		/**
+		 * Writes the particle count and the particles of a text state. The particles are formatted in blocks of one chunk per
+		 * hardware thread, each chunk into a buffer of its own, and each block is written out in order before the next is formatted.
+		 */
+		void write_particles(std::ostream& out, const HostParticlePhaseSpace& pa, ParticleFormatter format)
 		{
-			icsout << pa.r()[i].x << " " << pa.r()[i].y << " " << pa.r()[i].z << std::endl;
-			icsout << pa.v()[i].x << " " << pa.v()[i].y << " " << pa.v()[i].z << std::endl;
-			icsout << "0 0 0 0 0 0 0 0 0 0 0 0 0" << std::endl;
-			icsout << "0.0 0.0 0.0 0.0 0.0" << std::endl << "0.0 0.0 0.0 0.0 0.0" << std::endl << "0.0 0.0 0.0" << std::endl;
+			TextBuffer count;
+			append_count(count, pa.n());
+			count.write_to(out);
+
+			size_t n = pa.n();
+			size_t n_thread = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), std::max<size_t>(1, (n + FORMAT_CHUNK_SIZE - 1) / FORMAT_CHUNK_SIZE));
+			std::vector<TextBuffer> buffers(n_thread);
+
+			for (size_t block = 0; block < n; block += n_thread * FORMAT_CHUNK_SIZE)
+			{
+				size_t chunks = std::min(n_thread, (n - block + FORMAT_CHUNK_SIZE - 1) / FORMAT_CHUNK_SIZE);
+
+				std::vector<std::thread> threads;
+				for (size_t t = 1; t < chunks; t++)
+				{
+					size_t begin = block + t * FORMAT_CHUNK_SIZE;
+					threads.emplace_back(format, std::ref(buffers[t]), std::cref(pa), begin, std::min(n, begin + FORMAT_CHUNK_SIZE));
+				}
+
+				format(buffers[0], pa, block, std::min(n, block + FORMAT_CHUNK_SIZE));
+
+				for (std::thread& thread : threads)
+				{
+					thread.join();
+				}
+
+				for (size_t t = 0; t < chunks; t++)
+				{
+					buffers[t].write_to(out);
+					buffers[t].clear();
+				}
+			}
 		}
 	}
 
-	void save_data(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, const Configuration& config, const std::string& outfile)
+	void save_data_hybrid(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, const Configuration& config, std::ostream& out)
+	{
+		write_planets(out, pl, config.writemomenta, true);
+		write_particles(out, pa, &format_hybrid_particles);
+	}
+
+	void save_data_nohybrid(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, const Configuration& config, std::ostream& plout, std::ostream& icsout)
+	{
+		write_planets(plout, pl, config.writemomenta, false);
+		write_particles(icsout, pa, &format_split_particles);
+	}
+
+	void save_data_swift(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, std::ostream& plout, std::ostream& icsout)
+	{
+		write_planets(plout, pl, false, false);
+		write_particles(icsout, pa, &format_swift_particles);
+	}
+
+	void save_data(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, const Configuration& config, const std::string& outfile, double time)
 	{
 		if (!config.writesplit)
 		{
 			std::ostringstream ss;
 
-			if (config.writebinary)
+			if (config.writebinary == 2)
+			{
+				std::ofstream out(outfile, std::ios_base::binary);
+				save_data_columnar(pl, pa, config, out, time);
+			}
+			else if (config.writebinary)
 			{
 				std::ofstream out(outfile, std::ios_base::binary);
 				save_data_hybrid_binary(pl, pa, config, out);
@@ -771,8 +1740,6 @@ namespace data
 				sr::data::write_binary(trackout, static_cast<float>(pa.v[i].z));
 			}
 		}
-
-		trackout.flush();
 	}
 
 	void TrackReader::check_state(const State& expected)
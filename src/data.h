@@ -31,6 +31,9 @@ namespace data
 		 * dead particles in the array in order to speed up CUDA calls.
 		 * However, when running in CPU-only mode, the array maybe out of order
 		 * after integrator->step_particles_timeblock() is called and before resync() is called.
+		 *
+		 * In the integrator, the alive particles are also kept in ID order: they are sorted once when they are loaded,
+		 * and every later reordering is a stable partition, which keeps the alive particles in the same relative order.
 		 */
 		size_t n_alive;
 
@@ -40,8 +43,9 @@ namespace data
 		 * These may also contain the orbital elements a, e, i
 		 * when a HostParticleSnapshot is returned from reading
 		 * particle tracks.
+		 * Stored as separate x, y and z columns; see `soa_3`.
 		 */
-		Vf64_3 r;
+		SoAf64_3 r;
 
 		/**
 		 * The cartesian velocity vectors of the particles.
@@ -49,8 +53,9 @@ namespace data
 		 * These may also contain the orbital elements O, o, f
 		 * when a HostParticleSnapshot is returned from reading
 		 * particle tracks.
+		 * Stored as separate x, y and z columns; see `soa_3`.
 		 */
-		Vf64_3 v;
+		SoAf64_3 v;
 
 		/**
 		 * The IDs of the particles.
@@ -60,8 +65,8 @@ namespace data
 		/**
 		 * Implements the gather operation on all of the particle arrays.
 		 * The gather operation reorders the particle data in the order provided
-		 * by the `indices` array.
-		 * See `sr::data::gather<T>` for details on the gather operation.
+		 * by the `indices` array, which must be a permutation.
+		 * See `sr::data::gather<T>` for details on the gather operation, and `sr::data::permute` for how it is done.
 		 */
 		void gather(const std::vector<size_t>& indices, size_t begin, size_t length);
 
@@ -132,6 +137,52 @@ namespace data
 		inline HostPlanetSnapshot(size_t n_) : n(n_), n_alive(n_), r(n_), v(n_), id(n_), m(n_) { }
 	};
 
+	/**
+	 * Maps particle IDs to their indices in the particle arrays, so that a particle can be found without a search.
+	 * When the IDs span a range no more than a few times the particle count, the index is a flat array over that range;
+	 * otherwise it is an open-addressing hash table with linear probing. The set of IDs is fixed when the index is built,
+	 * and `update` only moves particles within it.
+	 */
+	class ParticleIdIndex
+	{
+	public:
+		/** Builds the index for the first `n` entries of `id`. Throws if an ID appears twice. */
+		void build(const Vu32& id, size_t n);
+
+		/** Updates the index after the particles in [begin, begin + length) have been reordered. */
+		void update(const Vu32& id, size_t begin, size_t length);
+
+		/** Gets the index of the particle with the given ID. Throws `std::out_of_range` if there is none. */
+		size_t at(uint32_t id) const;
+
+		/** Whether the index has been built. */
+		inline bool empty() const { return slots.empty(); }
+
+		inline ParticleIdIndex() : dense(true), min_id(0), shift(0), mask(0) { }
+
+	private:
+		struct Slot
+		{
+			uint32_t id;
+			uint32_t index;
+		};
+
+		/** Marks an unused slot in either layout. */
+		static const uint32_t EMPTY = static_cast<uint32_t>(-1);
+
+		/** Finds the slot for `id`: the slot holding it, or the empty slot where it would go. Sparse layout only. */
+		size_t probe(uint32_t id) const;
+
+		bool dense;
+		uint32_t min_id;
+
+		/** The hash is the top bits of a 32-bit product: 32 - `shift` bits, as many as `mask` has. */
+		uint32_t shift;
+		size_t mask;
+
+		/** Indexed by `id - min_id` in the dense layout, or by the hashed ID in the sparse layout. */
+		std::vector<Slot> slots;
+	};
 
 	struct HostParticlePhaseSpace
 	{
@@ -139,12 +190,12 @@ namespace data
 		HostParticleSnapshot base;
 
 		/** Gets the particle position array. */
-		inline Vf64_3& r() { return base.r; }
-		inline const Vf64_3& r() const { return base.r; }
+		inline SoAf64_3& r() { return base.r; }
+		inline const SoAf64_3& r() const { return base.r; }
 
 		/** Gets the particle velocity array. */
-		inline Vf64_3& v() { return base.v; }
-		inline const Vf64_3& v() const { return base.v; }
+		inline SoAf64_3& v() { return base.v; }
+		inline const SoAf64_3& v() const { return base.v; }
 
 		/** Gets the particle ID array. */
 		inline Vu32& id() { return base.id; }
@@ -165,8 +216,10 @@ namespace data
 		 *   Planet ID that killed the particle
 		 * Low byte:
 		 *   0x80 Particle absorbed by planet
-		 *   0x04 Kepler didn't converge
+		 *   0x08 Kepler didn't converge
+		 *   0x04 Unbound
 		 *   0x02 Out of bounds
+		 *   0x01 Close encounter
 		 */
 		inline Vu16& deathflags() { return _deathflags; }
 		inline const Vu16& deathflags() const { return _deathflags; }
@@ -195,14 +248,23 @@ namespace data
 		/** Execute stable partition on alive particles, i.e., `deathflags & 0x00FE = 0` */
 		std::unique_ptr<std::vector<size_t>> stable_partition_alive(size_t begin, size_t length);
 
+		/**
+		 * Execute stable partition on alive particles, writing the gather indices to `indices`.
+		 * The vector is reused, so that the executor loop does not allocate once it is large enough.
+		 */
+		void stable_partition_alive(size_t begin, size_t length, std::vector<size_t>& indices);
+
 		/** Execute stable partition on unflagged particles, i.e., `deathflags & 0x00FF = 0`. */
 		std::unique_ptr<std::vector<size_t>> stable_partition_unflagged(size_t begin, size_t length);
 
+		/** Execute stable partition on unflagged particles, writing the gather indices to `indices`. */
+		void stable_partition_unflagged(size_t begin, size_t length, std::vector<size_t>& indices);
+
 		/**
 		 * Implements the gather operation on all of the particle arrays.
 		 * The gather operation reorders the particle data in the order provided
-		 * by the indices array.
-		 * See sr::data::gather for details on the gather operation.
+		 * by the indices array, which must be a permutation.
+		 * See sr::data::gather for details on the gather operation, and sr::data::permute for how it is done.
 		 */
 		void gather(const std::vector<size_t>& indices, size_t begin, size_t length);
 
@@ -216,8 +278,25 @@ namespace data
 		 */
 		void filter(const std::vector<size_t>& filter, HostParticlePhaseSpace& out) const;
 
+		/**
+		 * Copies what output needs of the first `length` particles of `source`: their positions, velocities, IDs, death flags and death times.
+		 * The death time indices and the ID index are not copied. The arrays are only reallocated when they grow, so a buffer can be reused.
+		 */
+		void copy_for_output(const HostParticlePhaseSpace& source, size_t length);
+
+		/**
+		 * Builds the index from particle IDs to indices, see `index_of`. Once built, it is kept up to date
+		 * by `gather`, and so by the partitions and sorts; writing IDs through `id()` requires building it again.
+		 */
+		void build_id_index();
+
+		/** Gets the index of the particle with the given ID. `build_id_index` must have been called. */
+		inline size_t index_of(uint32_t id) const { return _id_index.at(id); }
+
 	private:
 
+		ParticleIdIndex _id_index;
+
 		Vu16 _deathflags;
 		Vf32 _deathtime;
 
@@ -340,24 +419,78 @@ namespace data
 		inline HostData() { }
 	};
 
+	/** The integration schemes that `Integrator` can select. */
+	enum class IntegratorType
+	{
+		/** Wisdom-Holman with the Jacobi Kepler drift of the planets, see `sr::wh::WHIntegrator`. */
+		WH,
+		/** The fourth-order SIA4 scheme, CPU-only, see `sr::sia4::SIA4Integrator`. */
+		SIA4
+	};
+
 	/** Contains all the integration options. */
 	struct Configuration
 	{
 		uint32_t max_kep;
 		double t_0, t_f, dt, big_g;
-		uint32_t num_thread;
+		uint32_t num_thread, cpu_chunk_size, cpu_planet_lookahead;
 		uint32_t tbsize, print_every, dump_every, track_every, energy_every, max_particle;
 		double wh_ce_r1, wh_ce_r2;
 		uint32_t wh_ce_n1, wh_ce_n2;
 		uint32_t split_track_file;
+		uint32_t writer_queue_size;
+
+		/** The most dump processes running at once when `fork_dumps` is set. */
+		uint32_t max_dump_processes;
+
+		/** The number of warm-up timeblocks after which any allocation in the executor loop is an error, or 0 to not check. */
+		uint32_t allocation_check_after;
 
 		uint32_t resync_every;
 
+		/**
+		 * If nonzero, the CPU executor resyncs whenever at least this fraction of the alive particles is flagged,
+		 * rather than every `resync_every` timeblocks.
+		 */
+		double resync_dead_fraction;
+
+		/**
+		 * Whether the CPU executor picks the timeblock lengths online, between `min_tbsize` and `tbsize`.
+		 * The intervals of the outputs still count whole `tbsize` steps.
+		 */
+		bool adaptive_tbsize;
+		uint32_t min_tbsize;
+
+		/** The length of the CPU executor's timeblocks when they are not adaptive, at most `tbsize`, or 0 for `tbsize`. */
+		uint32_t cpu_tbsize;
+
+		/** The tuning cache file, see `sr::exec::load_tuning`. Empty for the default path, "none" for no cache. */
+		std::string tuning_cache;
+
 		bool write_bary_track;
+		bool drop_track_frames;
+
+		/** Whether dumps are written by child processes forked from the integrator, see `sr::util::ForkedWriter`. */
+		bool fork_dumps;
+
+		bool cpu_particle_major;
+		bool cpu_fixed_kepler;
+
+		/** The distance ratio beyond which planet terms are evaluated in single precision, or 0 to keep them in double. See `Mixed-Precision-Ratio`. */
+		double mixed_precision_ratio;
+
+		uint32_t corrector_order;
+
+		IntegratorType integrator;
+
+		std::string cpu_isa;
 
 		double cull_radius;
 
-		bool readmomenta, writemomenta, trackbinary, readsplit, writesplit, dumpbinary, writebinary, readbinary;
+		bool readmomenta, writemomenta, trackbinary, readsplit, writesplit, dumpbinary, readbinary;
+
+		/** The format of the output states: 0 for text, 1 for interleaved binary, 2 for columnar binary, see `save_data_columnar`. */
+		uint32_t writebinary;
 
 		std::string icsin, plin, hybridin, hybridout;
 		std::string outfolder;
@@ -539,8 +672,8 @@ namespace data
 	 * The `begin` argument specifies an offset into only the `values` array.
 	 * Do not add `begin` to each element in `indices`.
 	 */
-	template<typename T>
-	void gather(std::vector<T>& values, const std::vector<size_t>& indices, size_t begin, size_t length)
+	template<typename T, typename Alloc>
+	void gather(std::vector<T, Alloc>& values, const std::vector<size_t>& indices, size_t begin, size_t length)
 	{
 		std::vector<T> copy(values.begin() + begin, values.begin() + begin + length);
 		for (size_t i = begin; i < begin + length; i++)
@@ -549,17 +682,130 @@ namespace data
 		}
 	}
 
+	/**
+	 * The gather operation on each of the columns of a `soa_3`.
+	 */
+	template<typename T>
+	void gather(soa_3<T>& values, const std::vector<size_t>& indices, size_t begin, size_t length)
+	{
+		gather(values.x, indices, begin, length);
+		gather(values.y, indices, begin, length);
+		gather(values.z, indices, begin, length);
+	}
+
+	/**
+	 * Applies the gather operation with `indices`, which must be a permutation of [0, `length`), to one column in place.
+	 * The column is swept once in order, from `first`, below which `indices` must leave the entries in place.
+	 * Entry i is read from entry `indices[i]`, which is still unchanged whenever `indices[i] >= i`. The entries that are read
+	 * from further forward have already been overwritten by then, so they are saved before the sweep. For a stable partition,
+	 * these are only the entries moved to the back, e.g. the particles that died.
+	 * The scratch memory is kept between calls, one buffer per thread and element type, so that permuting does not allocate once it has grown.
+	 */
+	template<typename T, typename Alloc>
+	void permute_column(const std::vector<size_t>& indices, size_t begin, size_t length, size_t first, std::vector<T, Alloc>& values)
+	{
+		static thread_local std::vector<T> saved;
+		saved.clear();
+
+		for (size_t i = first; i < length; i++)
+		{
+			if (indices[i] < i) saved.push_back(values[begin + indices[i]]);
+		}
+
+		size_t next = 0;
+		for (size_t i = first; i < length; i++)
+		{
+			size_t k = indices[i];
+			values[begin + i] = k < i ? saved[next++] : values[begin + k];
+		}
+	}
+
+	template<typename T>
+	void permute_column(const std::vector<size_t>& indices, size_t begin, size_t length, size_t first, soa_3<T>& values)
+	{
+		permute_column(indices, begin, length, first, values.x);
+		permute_column(indices, begin, length, first, values.y);
+		permute_column(indices, begin, length, first, values.z);
+	}
+
+	/**
+	 * Applies the gather operation with the same `indices` to all of `columns`, in place and without a copy of the range.
+	 * Unlike `gather`, `indices` must be a permutation of [0, `length`). The prefix that the permutation leaves in place
+	 * is found once and skipped in every column. See `permute_column`.
+	 */
+	template<typename... Columns>
+	void permute(const std::vector<size_t>& indices, size_t begin, size_t length, Columns&... columns)
+	{
+		size_t first = 0;
+		while (first < length && indices[first] == first) first++;
+
+		int expand[] = { 0, (permute_column(indices, begin, length, first, columns), 0)... };
+		(void) expand;
+	}
+
 	bool load_planet_data(HostPlanetPhaseSpace& pl, const Configuration& config, std::istream& plin);
-	bool load_data(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config);
+
+	/**
+	 * Loads the state named by `config`. Binary input can be in either the interleaved or the columnar format, which is told apart
+	 * by its header. If the file records the simulation time, as the columnar format does, it is stored to `time`.
+	 * Returns true if the file could not be read.
+	 */
+	bool load_data(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config, double* time = nullptr);
+
+	/** The particle columns of a columnar state file, as a bit mask. The planets are always loaded whole. */
+	namespace state_column
+	{
+		const uint32_t ID = 0x01;
+		const uint32_t R = 0x02;
+		const uint32_t V = 0x04;
+		const uint32_t DEATHFLAGS = 0x08;
+		const uint32_t DEATHTIME = 0x10;
+		const uint32_t ALL = 0x1F;
+	}
+
+	/** The header of a columnar state file. */
+	struct StateHeader
+	{
+		uint32_t version;
+		uint64_t planet_count, particle_count;
+
+		/** The number of particles at the start of the file that are alive. */
+		uint64_t alive_count;
+
+		double time;
+
+		/** Whether the file was written on a host of the other byte order. */
+		bool swapped;
+
+		/** Whether the planet velocities are momenta. */
+		bool momenta;
+
+		/** Whether the coordinates are barycentric rather than heliocentric. */
+		bool barycentric;
+	};
+
+	/** Whether the file at `path` is a columnar state file. */
+	bool is_columnar_state(const std::string& path);
+
+	/**
+	 * Loads part of the columnar state file `config.hybridin`: only the particle columns in `columns` (see `state_column`),
+	 * and only the alive particles at the start of the file if `alive_only` is set. Only the parts that are loaded are read
+	 * and have their checksums verified; the other columns are left zero, which leaves the particles alive.
+	 * Throws if the file is not a valid columnar state, or a checksum does not match. Fills `header` if it is not null.
+	 */
+	void load_data_columnar(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config, uint32_t columns, bool alive_only, StateHeader* header = nullptr);
 
 	size_t stable_partition_alive_indices(const std::vector<uint16_t>& flags, size_t begin, size_t length, std::unique_ptr<std::vector<size_t>>* indices);
+	size_t stable_partition_alive_indices(const std::vector<uint16_t>& flags, size_t begin, size_t length, std::vector<size_t>& indices);
 
-	void save_data(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, const Configuration& config, const std::string& outfile);
+	/** Saves a state in the format that `config` selects. `time` is recorded by the formats that have room for it. */
+	void save_data(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, const Configuration& config, const std::string& outfile, double time = 0);
 	void save_data_swift(const HostPlanetSnapshot& pl, const HostParticlePhaseSpace& pa, std::ostream& plout, std::ostream& icsout);
 
 	void read_configuration(std::istream& in, Configuration* out);
 	void write_configuration(std::ostream& in, const Configuration& config);
 
+	/** Writes one frame to a binary track. The stream is not flushed, so that callers can flush after a batch of frames. */
 	void save_binary_track(std::ostream& trackout, const HostPlanetSnapshot& pl, const HostParticleSnapshot& pa, double time, bool to_elements, bool barycentric_elements);
 
 	struct TrackReader
@@ -0,0 +1,441 @@
+#ifdef NO_CUDA
+#include <iomanip>
+#include <algorithm>
+
+#include "executor.h"
+#include "convert.h"
+#include "kernels.h"
+#include "allocation_counter.h"
+
+namespace sr
+{
+namespace exec
+{
+	using namespace sr::wh;
+	using namespace sr::util;
+	using namespace sr::convert;
+	using namespace sr::data;
+
+	namespace
+	{
+		// The parts of the executor loop, as allocation scopes. The queued jobs open scopes of their own.
+		const size_t loop_scope = allocation_scope_id("loop");
+		const size_t planet_scope = allocation_scope_id("planet_step");
+		const size_t particle_scope = allocation_scope_id("particle_step");
+		const size_t resync_scope = allocation_scope_id("resync");
+		const size_t job_scope = allocation_scope_id("jobs");
+
+		/** The allocations of the executor loop so far, not counting the queued jobs. */
+		uint64_t loop_allocation_count()
+		{
+			return allocation_count(loop_scope) + allocation_count(planet_scope) + allocation_count(particle_scope) + allocation_count(resync_scope);
+		}
+	}
+
+	Executor::Executor(HostData& _hd, const Configuration& _config, std::ostream& out)
+		: hd(_hd), pool(_config.num_thread), timeblock_steps(_config.tbsize), interval_finished(true), loop_allocations(0), output(out),
+		resync_counter(0), config(_config), mixed_precision_error(0), mixed_precision_samples(0), mixed_precision_offset(0) { }
+
+	void Executor::init()
+	{
+		const sr::kernels::KernelSet& kernels = sr::kernels::select(config.cpu_isa);
+
+		to_helio(hd);
+
+		// The deathtime index is not read from the input file; it is only used by the CPU integrator
+		hd.particles.deathtime_index() = Vu32(hd.particles.n());
+
+		// Before the integrator moves the planets into mapping coordinates
+		calculate_planet_metrics(hd.planets, &e_0, nullptr);
+
+		if (config.integrator == IntegratorType::SIA4)
+		{
+			sia4 = SIA4Integrator(hd.planets, config);
+		}
+		else
+		{
+			integrator = WHIntegrator(hd.planets, hd.particles, config);
+			integrator.reset_active_particles(hd.particles);
+			planet_integrator = integrator;
+		}
+
+		planet_sia4 = sia4;
+		planet_state = hd.planets;
+		planet_t = t;
+		planet_interval_t = t;
+		planet_interval_step = 0;
+		uint32_t cpu_tbsize = config.cpu_tbsize ? config.cpu_tbsize : config.tbsize;
+		controller.reset(config.adaptive_tbsize ? config.min_tbsize : cpu_tbsize, config.adaptive_tbsize ? config.tbsize : cpu_tbsize);
+
+		output << std::setprecision(7);
+		output << "e_0 (planets) = " << e_0 << std::endl;
+		output << "n_particle = " << hd.particles.n() << std::endl;
+		output << "n_particle_alive = " << hd.particles.n_alive() << std::endl;
+		output << "n_thread = " << pool.size() << std::endl;
+		output << "planet_lookahead = " << config.cpu_planet_lookahead << std::endl;
+		if (config.adaptive_tbsize)
+		{
+			output << "tbsize = adaptive, " << config.min_tbsize << " to " << config.tbsize << std::endl;
+		}
+		else if (cpu_tbsize != config.tbsize)
+		{
+			output << "tbsize = " << cpu_tbsize << std::endl;
+		}
+		output << "cpu_isa = " << kernels.name << std::endl;
+		output << "integrator = " << (config.integrator == IntegratorType::SIA4 ? "SIA4" : "WH") << std::endl;
+		if (config.mixed_precision_ratio > 0)
+		{
+			output << "mixed_precision_ratio = " << config.mixed_precision_ratio << ", error bound = " << integrator.mixed_precision_bound(hd.planets) << std::endl;
+		}
+		output << "==================================" << std::endl;
+
+		starttime = std::chrono::high_resolution_clock::now();
+
+		output << "       Starting simulation.       " << std::endl << std::endl;
+
+		PlanetTimeblock prototype;
+		prototype.r_log = hd.planets.r_log().log;
+		prototype.v_log = hd.planets.v_log().log;
+		prototype.h0_log = config.integrator == IntegratorType::SIA4 ? sia4.planet_h0_log.log : integrator.planet_h0_log.log;
+
+		pipeline.start(config.cpu_planet_lookahead, prototype, [this](PlanetTimeblock& block) { produce_planets(block); });
+	}
+
+	void Executor::produce_planets(PlanetTimeblock& block)
+	{
+		AllocationScope allocation_scope(planet_scope);
+
+		// A timeblock never crosses the end of an interval, so that the outputs are taken at the same times whatever the lengths
+		uint32_t steps = std::min(controller.steps(), config.tbsize - planet_interval_step);
+
+		block.t = planet_t;
+		block.steps = steps;
+
+		// The integrators write the timeblock into the old logs, which are then swapped into the slot
+		if (config.integrator == IntegratorType::SIA4)
+		{
+			planet_sia4.tbsize = steps;
+			planet_sia4.integrate_planets_timeblock(planet_state, planet_t);
+			std::swap(planet_sia4.planet_h0_log.old, block.h0_log);
+		}
+		else
+		{
+			planet_integrator.tbsize = steps;
+			planet_integrator.integrate_planets_timeblock(planet_state, planet_t);
+			std::swap(planet_integrator.planet_h0_log.old, block.h0_log);
+		}
+
+		std::swap(planet_state.r_log().old, block.r_log);
+		std::swap(planet_state.v_log().old, block.v_log);
+		block.planets = planet_state.base;
+
+		// The time is counted from the start of the interval, so that the ends of the intervals do not depend on the lengths
+		planet_interval_step += steps;
+		block.ends_interval = planet_interval_step == config.tbsize;
+
+		if (block.ends_interval)
+		{
+			planet_interval_t += config.dt * static_cast<double>(config.tbsize);
+			planet_interval_step = 0;
+		}
+
+		planet_t = planet_interval_t + config.dt * static_cast<double>(planet_interval_step);
+		block.t_end = planet_t;
+	}
+
+	void Executor::consume_planets()
+	{
+		AllocationScope allocation_scope(planet_scope);
+
+		PlanetTimeblock& block = pipeline.acquire();
+
+		hd.planets.base = block.planets;
+		std::swap(hd.planets.r_log().log, block.r_log);
+		std::swap(hd.planets.v_log().log, block.v_log);
+
+		if (config.integrator == IntegratorType::SIA4)
+		{
+			std::swap(sia4.planet_h0_log.log, block.h0_log);
+			sia4.tbsize = block.steps;
+		}
+		else
+		{
+			std::swap(integrator.planet_h0_log.log, block.h0_log);
+			integrator.tbsize = block.steps;
+		}
+
+		timeblock_steps = block.steps;
+		interval_finished = block.ends_interval;
+		t_end = block.t_end;
+
+		// The slot now holds the logs of the previous timeblock, which no particle reads anymore
+		pipeline.release();
+	}
+
+	void Executor::to_real_coordinates(HostPlanetSnapshot& planets, HostParticlePhaseSpace* particles) const
+	{
+		if (config.integrator != IntegratorType::WH) return;
+
+		HostPlanetPhaseSpace pl;
+		pl.base = std::move(planets);
+		integrator.to_real_coordinates(pl, particles);
+		planets = std::move(pl.base);
+	}
+
+	void Executor::add_job(const std::function<void()>& job)
+	{
+		work.push_back(job);
+	}
+
+	void Executor::download_data(bool ignore_errors)
+	{
+		(void) ignore_errors;
+
+		// Outputs must see the same particles as with a resync after every timeblock
+		if (config.resync_dead_fraction > 0 && flagged_particles() > 0)
+		{
+			resync();
+		}
+	}
+
+	double Executor::time() const
+	{
+		auto now = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double, std::milli> millis = now - starttime;
+		return millis.count() / 60000;
+	}
+
+	size_t Executor::chunk_size() const
+	{
+		if (config.cpu_chunk_size > 0)
+		{
+			return config.cpu_chunk_size;
+		}
+
+		// Enough chunks per thread that stealing can even out the load, but not so small that
+		// the per-chunk overhead shows up
+		return std::max<size_t>(64, hd.particles.n_alive() / (pool.size() * 16));
+	}
+
+	bool Executor::particle_major() const
+	{
+		return config.cpu_particle_major && config.integrator == IntegratorType::WH;
+	}
+
+	void Executor::integrate_particles(size_t begin, size_t length, float64_t t_block)
+	{
+		if (particle_major())
+		{
+			integrator.integrate_active_particles_timeblock(hd.planets, hd.particles, begin, length, t_block);
+			return;
+		}
+
+		// Particles that are already dead are masked for the whole timeblock and keep a zero index,
+		// so a nonzero index after a death means the particle died during this timeblock
+		for (size_t i = begin; i < begin + length; i++)
+		{
+			hd.particles.deathtime_index()[i] = 0;
+		}
+
+		if (config.integrator == IntegratorType::SIA4)
+		{
+			sia4.integrate_particles_timeblock(hd.planets, hd.particles, begin, length, t_block);
+		}
+		else
+		{
+			integrator.integrate_particles_timeblock(hd.planets, hd.particles, begin, length, t_block);
+		}
+
+		for (size_t i = begin; i < begin + length; i++)
+		{
+			if (hd.particles.deathflags()[i] && hd.particles.deathtime_index()[i])
+			{
+				hd.particles.deathtime()[i] = static_cast<float>(t_block + config.dt * static_cast<double>(hd.particles.deathtime_index()[i]));
+			}
+		}
+	}
+
+	void Executor::loop(double* cputimeout, double* gputimeout)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		// The queued work reads the particle arrays, so it has to run before the workers start
+		{
+			AllocationScope job_allocation_scope(job_scope);
+			for (auto& i : work) i();
+			work.clear();
+		}
+
+		AllocationScope allocation_scope(loop_scope);
+		uint64_t allocations = loop_allocation_count();
+
+		// The controller only sees the integration, since the jobs do not depend on the timeblock length
+		auto loop_start = std::chrono::high_resolution_clock::now();
+
+		// Only waits if the planet thread has fallen behind
+		consume_planets();
+
+		// Copy assignment ctor
+		hd.planets_snapshot = hd.planets.base;
+
+		auto particle_start = std::chrono::high_resolution_clock::now();
+		size_t n_alive = hd.particles.n_alive();
+		float64_t t_block = t;
+
+		// The particle-major engine only visits particles in the active list
+		size_t n_work = particle_major() ? integrator.particle_active.size() : n_alive;
+
+		if (n_work > 0)
+		{
+			pool.launch(0, n_work, chunk_size(), [this, t_block](size_t, size_t begin, size_t end)
+				{
+					AllocationScope particle_allocation_scope(particle_scope);
+					integrate_particles(begin, end - begin, t_block);
+				});
+		}
+
+		t = t_end;
+
+		if (n_work > 0)
+		{
+			pool.wait();
+		}
+
+		if (particle_major())
+		{
+			AllocationScope particle_allocation_scope(particle_scope);
+			integrator.compact_active_particles(hd.particles);
+		}
+
+		if (config.mixed_precision_ratio > 0)
+		{
+			sample_mixed_precision();
+		}
+
+		auto particle_finish = std::chrono::high_resolution_clock::now();
+
+		std::chrono::duration<double, std::milli> cputime = particle_start - start;
+		std::chrono::duration<double, std::milli> particletime = particle_finish - particle_start;
+		if (cputimeout) *cputimeout = cputime.count();
+		if (gputimeout) *gputimeout = particletime.count();
+
+		if (n_alive > 0)
+		{
+			// Resync-Interval counts whole intervals, so that shorter timeblocks resync at the same times
+			if (interval_finished) resync_counter++;
+
+			if (resync_due())
+			{
+				resync();
+			}
+		}
+
+		loop_allocations = loop_allocation_count() - allocations;
+
+		std::chrono::duration<double, std::milli> looptime = std::chrono::high_resolution_clock::now() - loop_start;
+		controller.record(timeblock_steps, looptime.count());
+	}
+
+	bool Executor::resync_due() const
+	{
+		if (config.resync_dead_fraction <= 0)
+		{
+			return interval_finished && resync_counter % config.resync_every == 0;
+		}
+
+		size_t dead = flagged_particles();
+		return dead > 0 && static_cast<double>(dead) >= config.resync_dead_fraction * static_cast<double>(hd.particles.n_alive());
+	}
+
+	size_t Executor::flagged_particles() const
+	{
+		size_t n_alive = hd.particles.n_alive();
+
+		if (particle_major())
+		{
+			return n_alive - integrator.particle_active.size();
+		}
+
+		size_t flagged = 0;
+		for (size_t i = 0; i < n_alive; i++)
+		{
+			if (hd.particles.deathflags()[i]) flagged++;
+		}
+
+		return flagged;
+	}
+
+	void Executor::sample_mixed_precision()
+	{
+		size_t n_active = integrator.particle_active.size();
+		if (n_active == 0) return;
+
+		if (mixed_precision_offset >= n_active) mixed_precision_offset = 0;
+		size_t length = std::min(MIXED_PRECISION_SAMPLE, n_active - mixed_precision_offset);
+
+		float64_t error = integrator.mixed_precision_error(hd.planets, hd.particles, mixed_precision_offset, length);
+		mixed_precision_error = std::max(mixed_precision_error, error);
+		mixed_precision_samples += length;
+		mixed_precision_offset += length;
+	}
+
+	void Executor::resync()
+	{
+		AllocationScope allocation_scope(resync_scope);
+
+		size_t prev_alive = hd.particles.n_alive();
+
+		for (size_t i = 0; i < prev_alive; i++)
+		{
+			uint16_t& flags = hd.particles.deathflags()[i];
+
+			if ((flags & 0x00FF) == 0x0001)
+			{
+				// particle came too close to a planet - kill it
+				flags |= 0x0080;
+			}
+
+			if (flags & 0x0008)
+			{
+				output << "Warning: simulation did not converge on particle " << hd.particles.id()[i] << std::endl;
+			}
+
+			if (flags & 0x0004)
+			{
+				output << "Warning: particle " << hd.particles.id()[i] << " unbound" << std::endl;
+			}
+		}
+
+		hd.particles.stable_partition_alive(0, prev_alive, gather_indices);
+
+		// SIA4 keeps no per-particle state
+		if (config.integrator == IntegratorType::WH)
+		{
+			integrator.gather_particles(gather_indices, 0, prev_alive);
+			integrator.reset_active_particles(hd.particles);
+		}
+	}
+
+	void Executor::finish()
+	{
+		pipeline.stop();
+
+		for (auto& i : work) i();
+		work.clear();
+
+		resync();
+
+		for (auto& i : work) i();
+		work.clear();
+
+		output << "Simulation finished. t = " << t << ". n_particle = " << hd.particles.n_alive() << std::endl;
+
+		if (config.mixed_precision_ratio > 0)
+		{
+			output << "Mixed precision: largest acceleration error " << mixed_precision_error << " of the sun's pull, measured on "
+				<< mixed_precision_samples << " particle samples" << std::endl;
+		}
+	}
+}
+}
+#endif
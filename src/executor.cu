@@ -1,8 +1,8 @@
 #include <iomanip>
 #include <fstream>
-#include <unordered_map>
 #include <algorithm>
 #include <thread>
+#include <stdexcept>
 
 #include "util.cuh"
 #include "util.h"
@@ -10,6 +10,7 @@
 #include "executor.cuh"
 #include "wh.cuh"
 #include "convert.h"
+#include "allocation_counter.h"
 
 namespace sr
 {
@@ -20,13 +21,35 @@ namespace exec
 	using namespace sr::convert;
 	using namespace sr::data;
 
+	namespace
+	{
+		// The parts of the executor loop, as allocation scopes. The queued jobs open scopes of their own.
+		const size_t loop_scope = allocation_scope_id("loop");
+		const size_t planet_scope = allocation_scope_id("planet_step");
+		const size_t particle_scope = allocation_scope_id("particle_step");
+		const size_t resync_scope = allocation_scope_id("resync");
+		const size_t job_scope = allocation_scope_id("jobs");
+
+		/** The allocations of the executor loop so far, not counting the queued jobs. */
+		uint64_t loop_allocation_count()
+		{
+			return allocation_count(loop_scope) + allocation_count(planet_scope) + allocation_count(particle_scope) + allocation_count(resync_scope);
+		}
+	}
+
 	ExecutorData::ExecutorData() { }
 	ExecutorData::ExecutorData(size_t n)
 	{
-		r = v = std::vector<f64_3>(n);
-		deathflags = std::vector<uint16_t>(n);
-		id = std::vector<uint32_t>(n);
-		deathtime_index = std::vector<uint32_t>(n);
+		resize(n);
+	}
+
+	void ExecutorData::resize(size_t n)
+	{
+		r.resize(n);
+		v.resize(n);
+		deathflags.resize(n);
+		id.resize(n);
+		deathtime_index.resize(n);
 	}
 
 	struct DeviceParticleUnflaggedPredicate
@@ -41,19 +64,32 @@ namespace exec
 	};
 
 	Executor::Executor(HostData& _hd, DeviceData& _dd, const Configuration& _config, std::ostream& out)
-		: hd(_hd), dd(_dd), output(out), config(_config), resync_counter(0) { }
+		: hd(_hd), dd(_dd), timeblock_steps(_config.tbsize), interval_finished(true), loop_allocations(0), output(out), config(_config), resync_counter(0) { }
 
 	void Executor::init()
 	{
+		if (config.integrator != IntegratorType::WH)
+		{
+			throw std::runtime_error("Error: the SIA4 integrator is only available in the CPU-only build");
+		}
+
 		to_helio(hd);
 
-		integrator = sr::wh::WHCudaIntegrator(hd.planets, hd.particles, config);
+		// Before the integrator moves the planets into mapping coordinates
 		calculate_planet_metrics(hd.planets, &e_0, nullptr);
 
+		integrator = sr::wh::WHCudaIntegrator(hd.planets, hd.particles, config);
+
 		output << std::setprecision(7);
 		output << "e_0 (planets) = " << e_0 << std::endl;
 		output << "n_particle = " << hd.particles.n() << std::endl;
 		output << "n_particle_alive = " << hd.particles.n_alive() << std::endl;
+
+		if (config.adaptive_tbsize || config.resync_dead_fraction > 0 || config.cpu_tbsize != 0)
+		{
+			output << "Warning: Adaptive-Time-Block, Resync-Dead-Fraction and CPU-Time-Block-Size are only supported in CPU-only mode" << std::endl;
+		}
+
 		output << "==================================" << std::endl;
 		output << "Sending initial conditions to GPU." << std::endl;
 
@@ -83,6 +119,9 @@ namespace exec
 			upload_data(0, hd.particles.n());
 		}
 
+		// Lets resync find the particles that died on the GPU without searching for them
+		hd.particles.build_id_index();
+
 		download_data();
 
 		starttime = std::chrono::high_resolution_clock::now();
@@ -130,6 +169,14 @@ namespace exec
 		cudaStreamSynchronize(htd_stream);
 	}
 
+	void Executor::to_real_coordinates(HostPlanetSnapshot& planets, HostParticlePhaseSpace* particles) const
+	{
+		HostPlanetPhaseSpace pl;
+		pl.base = std::move(planets);
+		integrator.base.to_real_coordinates(pl, particles);
+		planets = std::move(pl.base);
+	}
+
 	void Executor::add_job(const std::function<void()>& job)
 	{
 		work.push_back(std::move(job));
@@ -139,7 +186,7 @@ namespace exec
 	{
 		auto& particles = dd.particle_phase_space();
 
-		Vu32 prev_ids(hd.particles.id().begin(), hd.particles.id().end());
+		ed.prev_ids.assign(hd.particles.id().begin(), hd.particles.id().end());
 
 		memcpy_dth(hd.particles.r(), particles.r, dth_stream, 0, 0, particles.n_alive);
 		cudaStreamSynchronize(dth_stream);
@@ -152,7 +199,7 @@ namespace exec
 
 		// This should NEVER happen. I think this is a recoverable 
 		// error, by swapping particle indices on the host, but that sounds annoying...
-		if (prev_ids != hd.particles.id())
+		if (ed.prev_ids != hd.particles.id())
 		{
 			output << "WARNING! ID MISMATCH! WARNING!" << std::endl;
 
@@ -187,17 +234,25 @@ namespace exec
 	void Executor::loop(double* cputimeout, double* gputimeout)
 	{
 		std::thread cpu_thread;
+
+		AllocationScope allocation_scope(loop_scope);
+		uint64_t allocations = loop_allocation_count();
 		
 		if (dd.particle_phase_space().n_alive > 0)
 		{
+			AllocationScope particle_allocation_scope(particle_scope);
+
 			cudaEventRecord(start_event, main_stream);
 			integrator.integrate_particles_timeblock_cuda(main_stream, dd.planet_data_id, dd.planet_phase_space(), dd.particle_phase_space());
 			cudaEventRecord(gpu_finish_event, main_stream);
 		}
 
 		// The queued work should begin RIGHT after the CUDA call
-		for (auto& i : work) i();
-		work.clear();
+		{
+			AllocationScope job_allocation_scope(job_scope);
+			for (auto& i : work) i();
+			work.clear();
+		}
 
 		// The snapshot contains the planet states at the end of the previous timestep - 
 		// consider removing this? We can use hd.planets.*_log_old()[-1] to replicate this functionality
@@ -206,7 +261,11 @@ namespace exec
 		hd.planets_snapshot = hd.planets.base;
 
 		t += config.dt * static_cast<double>(config.tbsize);
-		step_and_upload_planets();
+
+		{
+			AllocationScope planet_allocation_scope(planet_scope);
+			step_and_upload_planets();
+		}
 
 		if (dd.particle_phase_space().n_alive > 0)
 		{
@@ -240,10 +299,14 @@ namespace exec
 				resync();
 			}
 		}
+
+		loop_allocations = loop_allocation_count() - allocations;
 	}
 
 	void Executor::resync()
 	{
+		AllocationScope allocation_scope(resync_scope);
+
 		auto& particles = dd.particle_phase_space();
 		size_t prev_alive = particles.n_alive;
 
@@ -255,7 +318,7 @@ namespace exec
 
 		size_t diff = prev_alive - particles.n_alive;
 
-		ed = ExecutorData(diff);
+		ed.resize(diff);
 
 		memcpy_dth(ed.r, particles.r, dth_stream, 0, particles.n_alive, diff);
 		cudaStreamSynchronize(dth_stream);
@@ -276,34 +339,28 @@ namespace exec
 				ed.deathflags[i] |= 0x0080;
 			}
 
-			if ((ed.deathflags[i] & 0x00FF) == 0x0004)
+			if (ed.deathflags[i] & 0x0008)
 			{
 				output << "Warning: simulation did not converge on particle " << ed.id[i] << std::endl;
 			}
 
-			if ((ed.deathflags[i] & 0x00FF) == 0x0004)
+			if (ed.deathflags[i] & 0x0004)
+			{
+				output << "Warning: particle " << ed.id[i] << " unbound" << std::endl;
+			}
+
+			if (ed.deathflags[i] & 0x0002)
 			{
 				output << "Warning: particle " << ed.id[i] << " OOB" << std::endl;
 			}
 		}
 
-		std::unique_ptr<std::vector<size_t>> ed_indices;
-		stable_partition_alive_indices(ed.deathflags, 0, diff, &ed_indices);
-		gather(ed.r, *ed_indices, 0, diff);
-		gather(ed.v, *ed_indices, 0, diff);
-		gather(ed.id, *ed_indices, 0, diff);
-		gather(ed.deathflags, *ed_indices, 0, diff);
-		gather(ed.deathtime_index, *ed_indices, 0, diff);
-
-		std::unordered_map<size_t, size_t> indices;
-		for (size_t i = 0; i < prev_alive; i++)
-		{
-			indices[hd.particles.id()[i]] = i;
-		}
+		stable_partition_alive_indices(ed.deathflags, 0, diff, ed.ed_indices);
+		permute(ed.ed_indices, 0, diff, ed.r, ed.v, ed.id, ed.deathflags, ed.deathtime_index);
 
 		for (size_t i = 0; i < diff; i++)
 		{
-			size_t index = indices[ed.id[i]];
+			size_t index = hd.particles.index_of(ed.id[i]);
 			hd.particles.r()[index] = ed.r[i];
 			hd.particles.v()[index] = ed.v[i];
 			hd.particles.deathflags()[index] = ed.deathflags[i];
@@ -314,8 +371,8 @@ namespace exec
 			}
 		}
 
-		auto gather_indices = hd.particles.stable_partition_alive(0, prev_alive);
-		integrator.gather_particles(*gather_indices, 0, prev_alive);
+		hd.particles.stable_partition_alive(0, prev_alive, ed.gather_indices);
+		integrator.gather_particles(ed.gather_indices, 0, prev_alive);
 	}
 
 
@@ -20,10 +20,17 @@ namespace exec
 		std::vector<uint32_t> id, deathtime_index;
 		std::vector<uint16_t> deathflags;
 
-		std::unique_ptr<std::vector<size_t>> gather_indices;
+		/** The gather indices of the last resync, for the host particles and for the rows above. */
+		std::vector<size_t> gather_indices, ed_indices;
+
+		/** The host particle IDs before a download, to check that the device did not reorder them. */
+		std::vector<uint32_t> prev_ids;
 
 		ExecutorData();
 		ExecutorData(size_t size);
+
+		/** Resizes the rows, keeping their capacity so that resyncing does not allocate in the steady state. */
+		void resize(size_t size);
 	};
 
 	struct Executor
@@ -40,6 +47,13 @@ namespace exec
 		float64_t t;
 		float64_t e_0;
 
+		/** The number of steps in the last `loop()`, and whether it ended a whole interval. Timeblocks have a fixed length here. */
+		uint32_t timeblock_steps;
+		bool interval_finished;
+
+		/** The heap allocations made during the last `loop()`, on any thread, not counting the queued jobs. Always 0 unless built with ALLOCATION_STATS. */
+		uint64_t loop_allocations;
+
 		std::ostream& output;
 
 		size_t resync_counter;
@@ -65,6 +79,7 @@ namespace exec
 		void finish();
 		void swap_logs();
 		void step_and_upload_planets();
+		void to_real_coordinates(HostPlanetSnapshot& planets, HostParticlePhaseSpace* particles) const;
 	};
 }
 }
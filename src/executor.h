@@ -0,0 +1,149 @@
+#pragma once
+#include "data.h"
+#include "wh.h"
+#include "sia4.h"
+#include "thread_pool.h"
+#include "planet_pipeline.h"
+#include "timeblock_controller.h"
+#include <chrono>
+#include <functional>
+#include <ostream>
+
+namespace sr
+{
+namespace exec
+{
+	using namespace sr::wh;
+	using namespace sr::sia4;
+	using namespace sr::util;
+	using namespace sr::data;
+
+	/** The number of particles that the mixed precision error is measured on after each timeblock, see `Executor::sample_mixed_precision`. */
+	const size_t MIXED_PRECISION_SAMPLE = 1024;
+
+	/**
+	 * The CPU-only executor. Particles are integrated on a pool of `CPU-Thread-Count` worker threads,
+	 * while the planets are integrated on a thread of their own up to `CPU-Planet-Lookahead` timeblocks ahead,
+	 * so that the main thread only runs the queued jobs between timeblocks.
+	 * Unlike the CUDA executor, the host particle arrays are always authoritative,
+	 * so there is nothing to upload or download.
+	 */
+	struct Executor
+	{
+		HostData& hd;
+		WHIntegrator integrator;
+
+		/** Used instead of `integrator` when `config.integrator` is SIA4. */
+		SIA4Integrator sia4;
+		ThreadPool pool;
+
+		/**
+		 * The planets and the planet side of the integrator as the planet thread sees them, which can be several timeblocks
+		 * ahead of `hd.planets`. `hd.planets` and `integrator` only take in each timeblock from the pipeline.
+		 */
+		HostPlanetPhaseSpace planet_state;
+		WHIntegrator planet_integrator;
+		SIA4Integrator planet_sia4;
+		float64_t planet_t;
+
+		/**
+		 * The planet thread's position in the current interval of `Time-Block-Size` steps: the time at its start,
+		 * and the number of steps taken since. Timeblocks never cross the end of an interval.
+		 */
+		float64_t planet_interval_t;
+		uint32_t planet_interval_step;
+
+		/** Picks the timeblock lengths when `Adaptive-Time-Block` is on. Read by the planet thread. */
+		TimeblockController controller;
+
+		float64_t t;
+		float64_t e_0;
+
+		/** The number of steps in the last `loop()`, and whether it ended a whole interval of `Time-Block-Size` steps. */
+		uint32_t timeblock_steps;
+		bool interval_finished;
+
+		/** The time at the end of the timeblock that was last taken from the pipeline. */
+		float64_t t_end;
+
+		/** The heap allocations made during the last `loop()`, on any thread, not counting the queued jobs. Always 0 unless built with ALLOCATION_STATS. */
+		uint64_t loop_allocations;
+
+		std::ostream& output;
+
+		size_t resync_counter;
+
+		const Configuration& config;
+
+		std::chrono::time_point<std::chrono::high_resolution_clock> starttime;
+
+		std::vector<std::function<void()>> work;
+
+		/**
+		 * With `Mixed-Precision-Ratio`, the largest error of the mixed precision acceleration measured so far, relative to the sun's pull,
+		 * the number of particle samples it was measured on, and where in the active particles the next sample starts.
+		 */
+		float64_t mixed_precision_error;
+		uint64_t mixed_precision_samples;
+		size_t mixed_precision_offset;
+
+		/** The gather indices of the last resync, kept so that resyncing does not allocate. */
+		std::vector<size_t> gather_indices;
+
+		/** Declared last, so that the planet thread is stopped before the state it works on is destroyed. */
+		PlanetPipeline pipeline;
+
+		Executor(const Executor&) = delete;
+		Executor(HostData& hd, const Configuration& config, std::ostream& out);
+
+		void init();
+
+		/**
+		 * Brings the host arrays up to date for output. On the CPU they are what the integrator works on, but with `Resync-Dead-Fraction`
+		 * the particles flagged since the last resync are still among the alive ones, so they are resynced away first.
+		 */
+		void download_data(bool ignore_errors = false);
+
+		double time() const;
+		void loop(double* cputime, double* gputime);
+		void add_job(const std::function<void()>& job);
+		void resync();
+		void finish();
+
+		/** Integrates the planets for the next timeblock into `block`. Called from the planet thread. */
+		void produce_planets(PlanetTimeblock& block);
+
+		/** Takes the next timeblock from the pipeline into `hd.planets` and the integrator logs, waiting for it if needed. */
+		void consume_planets();
+
+		void to_real_coordinates(HostPlanetSnapshot& planets, HostParticlePhaseSpace* particles) const;
+
+		/**
+		 * Integrates the particles in [begin, begin + length) through the timeblock starting at `t_block`.
+		 * Called from the worker threads.
+		 */
+		void integrate_particles(size_t begin, size_t length, float64_t t_block);
+
+		/** Gets the number of particles in a chunk of work for the thread pool. */
+		size_t chunk_size() const;
+
+		/** Whether the particles run on the particle-major engine, which only the WH integrator has. */
+		bool particle_major() const;
+
+		/**
+		 * Whether to resync after this timeblock: by `Resync-Dead-Fraction` if it is set,
+		 * otherwise at the end of every `Resync-Interval`th interval of `Time-Block-Size` steps.
+		 */
+		bool resync_due() const;
+
+		/**
+		 * Measures the error of the mixed precision acceleration on up to `MIXED_PRECISION_SAMPLE` active particles, moving on through
+		 * the particles from one timeblock to the next, so that the measurement costs a fixed amount whatever the particle count.
+		 */
+		void sample_mixed_precision();
+
+		/** Gets the number of alive particles that have been flagged since the last resync. */
+		size_t flagged_particles() const;
+	};
+}
+}
@@ -0,0 +1,69 @@
+#ifdef NO_CUDA
+#include "executor_facade.h"
+#include "executor.h"
+#include "util.h"
+
+namespace sr
+{
+namespace data
+{
+	// There is no device in CPU-only mode
+	struct DeviceData { };
+}
+
+namespace exec
+{
+	using namespace sr::data;
+
+	ExecutorFacade::ExecutorFacade(HostData& _hd, const Configuration& config, std::ostream& out) :
+		hd(_hd),
+		impl(std::make_unique<Executor>(_hd, config, out)),
+		t(impl->t),
+		e_0(impl->e_0),
+		loop_allocations(impl->loop_allocations),
+		timeblock_steps(impl->timeblock_steps),
+		interval_finished(impl->interval_finished)
+	{
+	}
+
+	ExecutorFacade::~ExecutorFacade()
+	{
+	}
+
+	void ExecutorFacade::init()
+	{
+		impl->init();
+	}
+
+	void ExecutorFacade::download_data(bool ignore_errors)
+	{
+		impl->download_data(ignore_errors);
+	}
+
+	double ExecutorFacade::time() const
+	{
+		return impl->time();
+	}
+
+	void ExecutorFacade::loop(double* cputimeout, double* gputimeout)
+	{
+		impl->loop(cputimeout, gputimeout);
+	}
+
+	void ExecutorFacade::finish()
+	{
+		impl->finish();
+	}
+
+	void ExecutorFacade::add_job(const std::function<void()>& job)
+	{
+		impl->add_job(job);
+	}
+
+	void ExecutorFacade::to_real_coordinates(HostPlanetSnapshot& planets, HostParticlePhaseSpace* particles) const
+	{
+		impl->to_real_coordinates(planets, particles);
+	}
+}
+}
+#endif
@@ -14,7 +14,10 @@ namespace exec
 		dd(std::make_unique<DeviceData>()),
 		impl(std::make_unique<Executor>(_hd, *dd.get(), config, out)),
 		t(impl->t),
-		e_0(impl->e_0)
+		e_0(impl->e_0),
+		loop_allocations(impl->loop_allocations),
+		timeblock_steps(impl->timeblock_steps),
+		interval_finished(impl->interval_finished)
 	{
 	}
 
@@ -51,5 +54,10 @@ namespace exec
 	{
 		impl->add_job(job);
 	}
+
+	void ExecutorFacade::to_real_coordinates(HostPlanetSnapshot& planets, HostParticlePhaseSpace* particles) const
+	{
+		impl->to_real_coordinates(planets, particles);
+	}
 }
 }
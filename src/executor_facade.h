@@ -24,6 +24,15 @@ namespace sr
 			float64_t& t;
 			float64_t& e_0;
 
+			/** The heap allocations made by the last `loop()`, see `sr::util::allocation_count`. */
+			uint64_t& loop_allocations;
+
+			/**
+			 * The number of steps in the last `loop()`, and whether it ended a whole interval of `Time-Block-Size` steps.
+			 * The intervals of the outputs count whole intervals; see `Adaptive-Time-Block`.
+			 */
+			uint32_t& timeblock_steps;
+			bool& interval_finished;
 
 			ExecutorFacade(sr::data::HostData& hd, const sr::data::Configuration& config, std::ostream& out);
 			~ExecutorFacade();
@@ -34,6 +43,13 @@ namespace sr
 			void loop(double* cputimeout, double* gputimeout);
 			void add_job(const std::function<void()>& job);
 			void finish();
+
+			/**
+			 * Transforms copies of the planet and particle states, taken at the same time, from the mapping coordinates
+			 * that the integrator works on into real coordinates for output. This only does something if a symplectic
+			 * corrector is enabled. The particles are optional.
+			 */
+			void to_real_coordinates(sr::data::HostPlanetSnapshot& planets, sr::data::HostParticlePhaseSpace* particles) const;
 		};
 	}
 }
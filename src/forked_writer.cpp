@@ -0,0 +1,162 @@
+#include "forked_writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace sr
+{
+namespace util
+{
+	namespace
+	{
+		/** Writes a message to stderr without going through the stream buffers that the child shares with its parent. */
+		void report(const std::string& message)
+		{
+			std::string line = message + "\n";
+			const char* p = line.data();
+			size_t left = line.size();
+
+			while (left > 0)
+			{
+				ssize_t written = ::write(STDERR_FILENO, p, left);
+				if (written < 0 && errno == EINTR) continue;
+				if (written <= 0) return;
+
+				p += written;
+				left -= static_cast<size_t>(written);
+			}
+		}
+	}
+
+	ForkedWriter::ForkedWriter(size_t capacity) : _capacity(std::max<size_t>(capacity, 1))
+	{
+		children.reserve(_capacity);
+	}
+
+	ForkedWriter::~ForkedWriter()
+	{
+		while (!children.empty())
+		{
+			bool exited;
+			wait(0, true, &exited);
+		}
+	}
+
+	bool ForkedWriter::spawn(const std::string& name, const Task& task)
+	{
+		reap();
+
+		while (children.size() >= _capacity)
+		{
+			bool exited;
+			wait(0, true, &exited);
+		}
+		rethrow_error();
+
+		pid_t pid = ::fork();
+		if (pid < 0) return false;
+
+		if (pid == 0)
+		{
+			// Exit without running destructors or atexit handlers, which would flush the parent's buffered output a second time
+			int status = 0;
+			try
+			{
+				task();
+			}
+			catch (const std::exception& e)
+			{
+				report("Error: " + name + ": " + e.what());
+				status = 1;
+			}
+			catch (...)
+			{
+				report("Error: " + name + ": unknown exception");
+				status = 1;
+			}
+
+			::_exit(status);
+		}
+
+		Child child;
+		child.pid = pid;
+		child.name = name;
+		children.push_back(child);
+
+		return true;
+	}
+
+	void ForkedWriter::reap()
+	{
+		for (size_t i = 0; i < children.size(); )
+		{
+			bool exited;
+			wait(i, false, &exited);
+			if (!exited) i++;
+		}
+
+		rethrow_error();
+	}
+
+	void ForkedWriter::drain()
+	{
+		while (!children.empty())
+		{
+			bool exited;
+			wait(0, true, &exited);
+		}
+
+		rethrow_error();
+	}
+
+	void ForkedWriter::wait(size_t index, bool block, bool* exited)
+	{
+		const Child& child = children[index];
+
+		int status;
+		pid_t result;
+		do
+		{
+			result = ::waitpid(child.pid, &status, block ? 0 : WNOHANG);
+		}
+		while (result < 0 && errno == EINTR);
+
+		*exited = result != 0;
+		if (!*exited) return;
+
+		std::ostringstream ss;
+		if (result < 0)
+		{
+			ss << "Error: could not wait for the process writing " << child.name << ": " << std::strerror(errno);
+		}
+		else if (WIFSIGNALED(status))
+		{
+			ss << "Error: the process writing " << child.name << " was killed by signal " << WTERMSIG(status);
+		}
+		else if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+		{
+			ss << "Error: the process writing " << child.name << " failed with exit status " << WEXITSTATUS(status);
+		}
+
+		if (error.empty() && !ss.str().empty()) error = ss.str();
+		children.erase(children.begin() + static_cast<std::ptrdiff_t>(index));
+	}
+
+	void ForkedWriter::rethrow_error()
+	{
+		if (!error.empty())
+		{
+			std::string e = error;
+			error.clear();
+			throw std::runtime_error(e);
+		}
+	}
+}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace sr
+{
+namespace util
+{
+	/**
+	 * Runs output tasks in child processes forked from this one, so that a task writes from the copy-on-write image of the
+	 * state at the time of the fork, and the integrator carries on without copying or waiting for anything.
+	 * The number of children running at once is bounded, since each one holds on to the pages that the integrator changes.
+	 *
+	 * The child only has the thread that forked it, so a task must not touch other threads' state, such as the thread pool,
+	 * the planet pipeline or the background writer, or the streams that they use.
+	 */
+	class ForkedWriter
+	{
+	public:
+		using Task = std::function<void()>;
+
+		/** Ctor with the maximum number of children running at once. */
+		ForkedWriter(size_t capacity);
+
+		/** Waits for the remaining children before returning. Failures are discarded. */
+		~ForkedWriter();
+
+		ForkedWriter(const ForkedWriter&) = delete;
+		ForkedWriter& operator=(const ForkedWriter&) = delete;
+
+		/**
+		 * Forks a child that runs `task` and exits, blocking while the maximum number of children is running.
+		 * `name` describes the task in errors. Returns false, without running the task, if the fork fails.
+		 * If an earlier child failed, an exception is thrown here, as `reap()` does.
+		 */
+		bool spawn(const std::string& name, const Task& task);
+
+		/** Reaps the children that have exited, without blocking. Throws an `std::runtime_error` if any of them failed. */
+		void reap();
+
+		/** Blocks until every child has exited. Throws an `std::runtime_error` if any of them failed. */
+		void drain();
+
+		/** Gets the number of children that have not been reaped. */
+		inline size_t running() const { return children.size(); }
+
+		inline size_t capacity() const { return _capacity; }
+
+	private:
+		struct Child
+		{
+			pid_t pid;
+			std::string name;
+		};
+
+		/** Waits for the child at `index` and removes it, recording a failure if it did not exit cleanly. */
+		void wait(size_t index, bool block, bool* exited);
+
+		/** Throws and clears the first recorded failure. */
+		void rethrow_error();
+
+		size_t _capacity;
+		std::vector<Child> children;
+		std::string error;
+	};
+}
+}
@@ -0,0 +1,117 @@
+#include "kernels.h"
+
+#include <stdexcept>
+
+namespace sr
+{
+namespace kernels
+{
+	namespace
+	{
+		const KernelSet* selected = nullptr;
+
+		const KernelSet& kernel_set_for(Isa isa)
+		{
+			switch (isa)
+			{
+#if defined(__x86_64__) || defined(__i386__)
+				case Isa::SSE42:
+					return sse42::kernel_set;
+				case Isa::AVX2:
+					return avx2::kernel_set;
+				case Isa::AVX512:
+					return avx512::kernel_set;
+#else
+				case Isa::SSE42:
+				case Isa::AVX2:
+				case Isa::AVX512:
+#endif
+				case Isa::Generic:
+				default:
+					return generic::kernel_set;
+			}
+		}
+
+		const KernelSet& best_kernel_set()
+		{
+			const Isa order[] = { Isa::AVX512, Isa::AVX2, Isa::SSE42 };
+
+			for (Isa isa : order)
+			{
+				if (supported(isa))
+				{
+					return kernel_set_for(isa);
+				}
+			}
+
+			return generic::kernel_set;
+		}
+	}
+
+	const IsaLevel ISA_LEVELS[4] =
+	{
+		{ Isa::Generic, "generic" },
+		{ Isa::SSE42, "sse4.2" },
+		{ Isa::AVX2, "avx2" },
+		{ Isa::AVX512, "avx512" }
+	};
+
+	bool supported(Isa isa)
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_cpu_init();
+
+		switch (isa)
+		{
+			case Isa::Generic:
+				return true;
+			case Isa::SSE42:
+				return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+			case Isa::AVX2:
+				return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi2");
+			case Isa::AVX512:
+				return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")
+					&& supported(Isa::AVX2);
+			default:
+				return false;
+		}
+#else
+		return isa == Isa::Generic;
+#endif
+	}
+
+	const KernelSet& select(const std::string& name)
+	{
+		if (name == "auto")
+		{
+			selected = &best_kernel_set();
+			return *selected;
+		}
+
+		for (const IsaLevel& level : ISA_LEVELS)
+		{
+			if (name != level.name) continue;
+
+			if (!supported(level.isa))
+			{
+				throw std::runtime_error("Error: CPU-ISA " + name + " is not supported by this CPU");
+			}
+
+			selected = &kernel_set_for(level.isa);
+			return *selected;
+		}
+
+		throw std::runtime_error("Error: unknown CPU-ISA " + name + ", expected auto, generic, sse4.2, avx2 or avx512");
+	}
+
+	const KernelSet& kernels()
+	{
+		if (!selected)
+		{
+			selected = &best_kernel_set();
+		}
+
+		return *selected;
+	}
+}
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include "types.h"
+
+#include <string>
+
+namespace sr
+{
+namespace kernels
+{
+	/** The instruction set levels that the CPU kernels are compiled for. */
+	enum class Isa
+	{
+		Generic,
+		SSE42,
+		AVX2,
+		AVX512
+	};
+
+	/**
+	 * The number of particles that the batched kernels work on together.
+	 * Arrays passed to `drift` and `accelerate` must be a whole number of batches long.
+	 */
+	const size_t LANES = 8;
+
+	/**
+	 * A set of CPU kernels compiled for one instruction set level. Every set computes bit-identical results:
+	 * they run the same sequence of IEEE operations, with no contraction into fused multiply-adds,
+	 * and only differ in how many lanes each instruction works on.
+	 */
+	struct KernelSet
+	{
+		Isa isa;
+
+		/** The name of the instruction set level, as accepted by the `CPU-ISA` configuration key. */
+		const char* name;
+
+		typedef void (*Drift)(double* rx, double* ry, double* rz, double* vx, double* vy, double* vz, uint16_t* flags, const bool* active,
+				size_t n, double dt, double mu, uint32_t maxkep);
+
+		/**
+		 * Drifts `n` particles along their Kepler orbits, as `MVSKernelBase::drift`, `LANES` particles at a time.
+		 * Particles where `active` is not set are left untouched. Unbound particles are flagged with 0x04,
+		 * and particles where the Kepler solver does not converge in `maxkep` iterations are flagged with 0x08.
+		 */
+		Drift drift;
+
+		/**
+		 * As `drift`, but the Kepler solver always runs `maxkep` fourth-order iterations with no early exit,
+		 * so that every batch takes the same path. Convergence is checked once, on the result.
+		 * This does not give the same results as `drift`.
+		 */
+		Drift drift_fixed;
+
+		typedef void (*Accelerate)(const double* rx, const double* ry, const double* rz, double* ax, double* ay, double* az, uint16_t* flags, const bool* active,
+				size_t n, uint32_t planet_n, const f64_3& h0, const f64_3* r_log_step, const double* m, const double* rh2);
+
+		/**
+		 * Computes the heliocentric acceleration on `n` particles from the planets in one timestep of the planet log,
+		 * as `MVSKernelBase::accelerate`, `LANES` particles at a time. Particles where `active` is not set are left untouched.
+		 * The table holds one kernel per planet count specialization and is indexed with `sr::wh::specialized_planets(planet_n)`.
+		 */
+		const Accelerate* accelerate;
+
+		typedef void (*AccelerateMixed)(const double* rx, const double* ry, const double* rz, double* ax, double* ay, double* az, uint16_t* flags,
+				const bool* active, size_t n, uint32_t planet_n, const f64_3& h0, const f64_3* r_log_step, const double* m, const double* rh2,
+				double far_ratio2);
+
+		/**
+		 * As `accelerate`, but the term of a planet that all `LANES` particles of a batch are far from, with the squared distance above
+		 * `far_ratio2` times the particle's squared heliocentric distance, is evaluated in single precision. See `Mixed-Precision-Ratio`.
+		 * The sets still agree with each other, but not with `accelerate`.
+		 */
+		const AccelerateMixed* accelerate_mixed;
+
+		/** Converts `n` cartesian states into orbital elements. See `sr::convert::to_elements`. */
+		void (*to_elements)(double mu, const double* rx, const double* ry, const double* rz, const double* vx, const double* vy, const double* vz,
+				size_t n, int* esign, double* a, double* e, double* i, double* capom, double* om, double* f);
+
+		/**
+		 * Removes the entries of `indices` that point at particles with nonzero `flags`, keeping the order of the rest.
+		 * Returns the new number of indices.
+		 */
+		size_t (*compact)(const uint16_t* flags, uint32_t* indices, size_t n);
+
+		/**
+		 * Fills `indices` with the stable partition of [0, n) into the entries where `flags & mask` is zero, followed by the rest,
+		 * and returns the number of the former. `indices` must hold `n` entries. The wide sets build the masks with vector compares
+		 * and store each vector of indices to both ends with compress operations.
+		 */
+		size_t (*partition)(const uint16_t* flags, uint16_t mask, size_t* indices, size_t n);
+	};
+
+	/** An instruction set level with its name, as accepted by the `CPU-ISA` configuration key. */
+	struct IsaLevel
+	{
+		Isa isa;
+		const char* name;
+	};
+
+	/** The instruction set levels, from the lowest to the highest. */
+	extern const IsaLevel ISA_LEVELS[4];
+
+	/** Returns whether the CPU that we are running on supports an instruction set level. */
+	bool supported(Isa isa);
+
+	/**
+	 * Selects the kernel set used by `kernels()`. `name` is either "auto", to pick the best level that the
+	 * CPU supports, or the name of a level. Throws if the name is unknown or the level is unsupported.
+	 * Must not be called while kernels are running.
+	 */
+	const KernelSet& select(const std::string& name);
+
+	/** Gets the selected kernel set. If `select` was not called, the best supported level is used. */
+	const KernelSet& kernels();
+
+	namespace generic { extern const KernelSet kernel_set; }
+#if defined(__x86_64__) || defined(__i386__)
+	namespace sse42 { extern const KernelSet kernel_set; }
+	namespace avx2 { extern const KernelSet kernel_set; }
+	namespace avx512 { extern const KernelSet kernel_set; }
+#endif
+}
+}
@@ -0,0 +1,111 @@
+#include "kernels.h"
+#include "mvs_kernel.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma,bmi,bmi2,popcnt")
+
+#include <immintrin.h>
+
+namespace sr
+{
+namespace kernels
+{
+namespace avx2
+{
+	using wh::TOLKEP;
+
+#define KERNELS_SIMD_LOOP _Pragma("omp simd")
+#define KERNELS_VECTOR_PARTITION
+#include "kernels_impl.h"
+#undef KERNELS_VECTOR_PARTITION
+#undef KERNELS_SIMD_LOOP
+
+	namespace
+	{
+		/** For each 4-bit lane mask, the order of 32-bit lanes that moves the selected 64-bit lanes to the front, in order. */
+		alignas(32) const int32_t COMPRESS_LANES[16][8] =
+		{
+			{ 0, 1, 0, 1, 0, 1, 0, 1 },
+			{ 0, 1, 0, 1, 0, 1, 0, 1 },
+			{ 2, 3, 0, 1, 0, 1, 0, 1 },
+			{ 0, 1, 2, 3, 0, 1, 0, 1 },
+			{ 4, 5, 0, 1, 0, 1, 0, 1 },
+			{ 0, 1, 4, 5, 0, 1, 0, 1 },
+			{ 2, 3, 4, 5, 0, 1, 0, 1 },
+			{ 0, 1, 2, 3, 4, 5, 0, 1 },
+			{ 6, 7, 0, 1, 0, 1, 0, 1 },
+			{ 0, 1, 6, 7, 0, 1, 0, 1 },
+			{ 2, 3, 6, 7, 0, 1, 0, 1 },
+			{ 0, 1, 2, 3, 6, 7, 0, 1 },
+			{ 4, 5, 6, 7, 0, 1, 0, 1 },
+			{ 0, 1, 4, 5, 6, 7, 0, 1 },
+			{ 2, 3, 4, 5, 6, 7, 0, 1 },
+			{ 0, 1, 2, 3, 4, 5, 6, 7 }
+		};
+
+		/** Stores the 64-bit lanes of `values` that `lanes` selects contiguously at `out`, leaving the entries after them untouched. */
+		inline void compress_store(size_t* out, int lanes, __m256i values)
+		{
+			__m256i order = _mm256_load_si256(reinterpret_cast<const __m256i*>(COMPRESS_LANES[lanes]));
+			__m256i store = _mm256_cmpgt_epi64(_mm256_set1_epi64x(_mm_popcnt_u32(lanes)), _mm256_setr_epi64x(0, 1, 2, 3));
+			_mm256_maskstore_epi64(reinterpret_cast<long long*>(out), store, _mm256_permutevar8x32_epi32(values, order));
+		}
+
+		size_t partition(const uint16_t* flags, uint16_t mask, size_t* indices, size_t n)
+		{
+			static_assert(sizeof(size_t) == sizeof(long long), "the indices are stored as 64-bit lanes");
+
+			// Counting only reads the flags, 16 at a time
+			const __m256i mask16 = _mm256_set1_epi16(static_cast<short>(mask));
+			size_t kept = 0, i = 0;
+			for (; i + 16 <= n; i += 16)
+			{
+				__m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(flags + i));
+				__m256i zero = _mm256_cmpeq_epi16(_mm256_and_si256(f, mask16), _mm256_setzero_si256());
+				kept += _mm_popcnt_u32(static_cast<uint32_t>(_mm256_movemask_epi8(zero))) / 2;
+			}
+			for (; i < n; i++)
+			{
+				kept += (flags[i] & mask) == 0;
+			}
+
+			const __m256i mask64 = _mm256_set1_epi64x(mask);
+			__m256i index = _mm256_setr_epi64x(0, 1, 2, 3);
+			size_t front = 0, back = kept;
+			for (i = 0; i + 4 <= n; i += 4)
+			{
+				__m256i f = _mm256_cvtepu16_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(flags + i)));
+				__m256i zero = _mm256_cmpeq_epi64(_mm256_and_si256(f, mask64), _mm256_setzero_si256());
+				int keep = _mm256_movemask_pd(_mm256_castsi256_pd(zero));
+				size_t n_keep = _mm_popcnt_u32(keep);
+
+				compress_store(indices + front, keep, index);
+				compress_store(indices + back, keep ^ 0xF, index);
+				front += n_keep;
+				back += 4 - n_keep;
+
+				index = _mm256_add_epi64(index, _mm256_set1_epi64x(4));
+			}
+			for (; i < n; i++)
+			{
+				bool keep = (flags[i] & mask) == 0;
+				indices[keep ? front : back] = i;
+				front += keep;
+				back += !keep;
+			}
+
+			return kept;
+		}
+	}
+
+	const KernelSet kernel_set = { Isa::AVX2, "avx2", &drift<false>, &drift<true>, accelerate_kernels, accelerate_mixed_kernels, &to_elements, &compact, &partition };
+}
+}
+}
+
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,81 @@
+#include "kernels.h"
+#include "mvs_kernel.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512dq,avx512vl,avx2,fma,bmi,bmi2,popcnt,prefer-vector-width=512")
+
+#include <immintrin.h>
+
+namespace sr
+{
+namespace kernels
+{
+namespace avx512
+{
+	using wh::TOLKEP;
+
+#define KERNELS_SIMD_LOOP _Pragma("omp simd")
+#define KERNELS_VECTOR_PARTITION
+#include "kernels_impl.h"
+#undef KERNELS_VECTOR_PARTITION
+#undef KERNELS_SIMD_LOOP
+
+	namespace
+	{
+		size_t partition(const uint16_t* flags, uint16_t mask, size_t* indices, size_t n)
+		{
+			// Counting only reads the flags, 16 at a time
+			const __m256i mask16 = _mm256_set1_epi16(static_cast<short>(mask));
+			size_t kept = 0, i = 0;
+			for (; i + 16 <= n; i += 16)
+			{
+				__m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(flags + i));
+				__m256i zero = _mm256_cmpeq_epi16(_mm256_and_si256(f, mask16), _mm256_setzero_si256());
+				kept += _mm_popcnt_u32(static_cast<uint32_t>(_mm256_movemask_epi8(zero))) / 2;
+			}
+			for (; i < n; i++)
+			{
+				kept += (flags[i] & mask) == 0;
+			}
+
+			const __m128i mask8 = _mm_set1_epi16(static_cast<short>(mask));
+			__m512i index = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+			size_t front = 0, back = kept;
+			for (i = 0; i + 8 <= n; i += 8)
+			{
+				__m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(flags + i));
+				__m128i zero = _mm_cmpeq_epi16(_mm_and_si128(f, mask8), _mm_setzero_si128());
+				__mmask8 keep = static_cast<__mmask8>(_pext_u32(static_cast<uint32_t>(_mm_movemask_epi8(zero)), 0x5555));
+				uint32_t n_keep = _mm_popcnt_u32(keep);
+
+				// Compressing in a register and storing with a mask is faster than a compressing store on some CPUs
+				_mm512_mask_storeu_epi64(indices + front, static_cast<__mmask8>((1u << n_keep) - 1), _mm512_maskz_compress_epi64(keep, index));
+				_mm512_mask_storeu_epi64(indices + back, static_cast<__mmask8>(0xFFu >> n_keep), _mm512_maskz_compress_epi64(static_cast<__mmask8>(~keep), index));
+				front += n_keep;
+				back += 8 - n_keep;
+
+				index = _mm512_add_epi64(index, _mm512_set1_epi64(8));
+			}
+			for (; i < n; i++)
+			{
+				bool keep = (flags[i] & mask) == 0;
+				indices[keep ? front : back] = i;
+				front += keep;
+				back += !keep;
+			}
+
+			return kept;
+		}
+	}
+
+	const KernelSet kernel_set = { Isa::AVX512, "avx512", &drift<false>, &drift<true>, accelerate_kernels, accelerate_mixed_kernels, &to_elements, &compact, &partition };
+}
+}
+}
+
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,22 @@
+#include "kernels.h"
+#include "mvs_kernel.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace sr
+{
+namespace kernels
+{
+namespace generic
+{
+	using wh::TOLKEP;
+
+#define KERNELS_SIMD_LOOP
+#include "kernels_impl.h"
+#undef KERNELS_SIMD_LOOP
+
+	const KernelSet kernel_set = { Isa::Generic, "generic", &drift<false>, &drift<true>, accelerate_kernels, accelerate_mixed_kernels, &to_elements, &compact, &partition };
+}
+}
+}
@@ -0,0 +1,599 @@
+// The bodies of the CPU kernels in kernels.h.
+//
+// This file has no include guard and is not a normal header: each kernels_<isa>.cpp includes it inside
+// its own namespace (sr::kernels::<isa>), after switching the compiler to that instruction set, so that every
+// function here is compiled once per level with distinct symbols. Anything that this file uses must already
+// have been included by that translation unit, and everything here must either be defined in this file
+// or be a builtin or a plain C library function - calling an inline function from another header would
+// let the linker pick one ISA's copy of it for the whole program.
+//
+// The lane loops are written so that the compiler maps them onto vector registers: fixed trip counts,
+// no branches inside the loops (masks are applied with selects), and no data-dependent exits except at the
+// end of a whole iteration across the lanes. The including file defines KERNELS_SIMD_LOOP to either nothing,
+// leaving the choice to the vectorizer, or to an `omp simd` pragma, which forces the lane loops to be vectorized
+// rather than unrolled. Forcing pays off for the wide vector units but not for SSE, where the 64-bit lane masks
+// have to be emulated. A file that defines KERNELS_VECTOR_PARTITION provides its own `partition` with intrinsics,
+// since compressing stores are not something the vectorizer produces.
+
+namespace
+{
+	/**
+	 * Computes the sine and cosine of `LANES` angles together. The angle is reduced modulo pi/2
+	 * with a three-part Cody-Waite reduction, and the Cephes minimax polynomials are evaluated on [-pi/4, pi/4],
+	 * so the results are within an ulp of `std::sin` and `std::cos` for the angles that the Kepler solver sees.
+	 * The quadrant is applied by selecting and negating the polynomial results.
+	 */
+	inline void sincos_lanes(const double* x, double* s, double* c)
+	{
+		// Adding 1.5 * 2^52 rounds to the nearest integer and leaves it in the low bits of the mantissa
+		const double SHIFTER = 6755399441055744.0;
+		const double TWO_OVER_PI = 6.36619772367581382433e-01;
+		const double PIO2_1 = 1.57079632673412561417e+00;
+		const double PIO2_2 = 6.07710050630396597660e-11;
+		const double PIO2_3 = 2.02226624879595063154e-21;
+
+		KERNELS_SIMD_LOOP
+		for (size_t k = 0; k < LANES; k++)
+		{
+			double t = x[k] * TWO_OVER_PI + SHIFTER;
+			uint64_t quadrant;
+			std::memcpy(&quadrant, &t, sizeof(t));
+			double q = t - SHIFTER;
+
+			double z = ((x[k] - q * PIO2_1) - q * PIO2_2) - q * PIO2_3;
+			double zz = z * z;
+
+			double ps = 1.58962301576546568060E-10;
+			ps = ps * zz - 2.50507477628578072866E-8;
+			ps = ps * zz + 2.75573136213857245213E-6;
+			ps = ps * zz - 1.98412698295895385996E-4;
+			ps = ps * zz + 8.33333333332211858878E-3;
+			ps = ps * zz - 1.66666666666666307295E-1;
+			ps = z + z * zz * ps;
+
+			double pc = -1.13585365213876817300E-11;
+			pc = pc * zz + 2.08757008419747316778E-9;
+			pc = pc * zz - 2.75573141792967388112E-7;
+			pc = pc * zz + 2.48015872888517045348E-5;
+			pc = pc * zz - 1.38888888888730564116E-3;
+			pc = pc * zz + 4.16666666666665929218E-2;
+			pc = 1.0 - 0.5 * zz + zz * zz * pc;
+
+			// sin(z + q pi/2) = sin z, cos z, -sin z, -cos z for q = 0, 1, 2, 3 (mod 4)
+			// cos(z + q pi/2) = cos z, -sin z, -cos z, sin z
+			bool swap = (quadrant & 1) != 0;
+			bool negate_sin = (quadrant & 2) != 0;
+			bool negate_cos = ((quadrant + 1) & 2) != 0;
+
+			double sv = swap ? pc : ps;
+			double cv = swap ? ps : pc;
+			s[k] = negate_sin ? -sv : sv;
+			c[k] = negate_cos ? -cv : cv;
+		}
+	}
+
+	/**
+	 * Solves Kepler's equation for `LANES` particles with Newton's method, as `MVSKernelBase::kepeq`.
+	 * Lanes where `done` is set on entry are not solved. A lane stops being updated when it converges,
+	 * and the loop exits once every lane has converged or after `maxkep` iterations.
+	 * On return, `done` is clear for the lanes that did not converge.
+	 */
+	inline void kepeq_lanes(const double* dM, const double* ecosEo, const double* esinEo, double* dE, double* sindE, double* cosdE,
+			int64_t* done, uint32_t maxkep)
+	{
+		sincos_lanes(dE, sindE, cosdE);
+
+		for (uint32_t i = 0; i < maxkep; i++)
+		{
+			int64_t all_done = 1;
+
+			KERNELS_SIMD_LOOP
+			for (size_t k = 0; k < LANES; k++)
+			{
+				double f = dE[k] - ecosEo[k] * sindE[k] + esinEo[k] * (1. - cosdE[k]) - dM[k];
+				double fp = 1. - ecosEo[k] * cosdE[k] + esinEo[k] * sindE[k];
+				double delta = -f / fp;
+
+				dE[k] += done[k] ? 0. : delta;
+				done[k] = done[k] | (std::fabs(delta) < TOLKEP);
+				all_done &= done[k];
+			}
+
+			sincos_lanes(dE, sindE, cosdE);
+
+			if (all_done) return;
+		}
+	}
+
+	/**
+	 * Solves Kepler's equation for `LANES` particles with exactly `iterations` iterations and no convergence test.
+	 * Each iteration applies Danby's fourth-order correction, whose higher derivatives come from the sine and cosine
+	 * that a Newton step needs anyway. Lanes where `done` is set on entry are not solved.
+	 * Afterwards, the residual of the result is checked and `done` is set for the lanes that converged.
+	 */
+	inline void kepeq_fixed_lanes(const double* dM, const double* ecosEo, const double* esinEo, double* dE, double* sindE, double* cosdE,
+			int64_t* done, uint32_t iterations)
+	{
+		sincos_lanes(dE, sindE, cosdE);
+
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			KERNELS_SIMD_LOOP
+			for (size_t k = 0; k < LANES; k++)
+			{
+				double f = dE[k] - ecosEo[k] * sindE[k] + esinEo[k] * (1. - cosdE[k]) - dM[k];
+				double fp = 1. - ecosEo[k] * cosdE[k] + esinEo[k] * sindE[k];
+				double fpp = ecosEo[k] * sindE[k] + esinEo[k] * cosdE[k];
+				double fppp = ecosEo[k] * cosdE[k] - esinEo[k] * sindE[k];
+
+				double delta = -f / fp;
+				delta = -f / (fp + 0.5 * delta * fpp);
+				delta = -f / (fp + 0.5 * delta * fpp + delta * delta * fppp / 6.);
+
+				dE[k] += done[k] ? 0. : delta;
+			}
+
+			sincos_lanes(dE, sindE, cosdE);
+		}
+
+		KERNELS_SIMD_LOOP
+		for (size_t k = 0; k < LANES; k++)
+		{
+			double f = dE[k] - ecosEo[k] * sindE[k] + esinEo[k] * (1. - cosdE[k]) - dM[k];
+			double fp = 1. - ecosEo[k] * cosdE[k] + esinEo[k] * sindE[k];
+
+			done[k] = done[k] | (std::fabs(f / fp) < TOLKEP);
+		}
+	}
+
+	template<bool fixed>
+	void drift(double* rx, double* ry, double* rz, double* vx, double* vy, double* vz, uint16_t* flags, const bool* active,
+			size_t n, double dt, double mu, uint32_t maxkep)
+	{
+		for (size_t b = 0; b < n; b += LANES)
+		{
+			double dist[LANES], a[LANES], n_[LANES], ecosEo[LANES], esinEo[LANES], dM[LANES], dE[LANES], sindE[LANES], cosdE[LANES];
+			int64_t act[LANES], unbound[LANES], done[LANES];
+
+			KERNELS_SIMD_LOOP
+			for (size_t k = 0; k < LANES; k++)
+			{
+				act[k] = active[b + k];
+			}
+
+			KERNELS_SIMD_LOOP
+			for (size_t k = 0; k < LANES; k++)
+			{
+				double x = rx[b + k], y = ry[b + k], z = rz[b + k];
+				double u = vx[b + k], v = vy[b + k], w = vz[b + k];
+
+				dist[k] = std::sqrt(x * x + y * y + z * z);
+				double vdotr = u * x + v * y + w * z;
+				double energy = (u * u + v * v + w * w) * 0.5 - mu / dist[k];
+
+				unbound[k] = energy >= 0;
+				done[k] = (act[k] ^ 1) | unbound[k];
+
+				a[k] = -0.5 * mu / energy;
+				n_[k] = std::sqrt(mu / (a[k] * a[k] * a[k]));
+				ecosEo[k] = 1.0 - dist[k] / a[k];
+				esinEo[k] = vdotr / (n_[k] * a[k] * a[k]);
+
+				// subtract off an integer multiple of complete orbits
+				dM[k] = dt * n_[k] - M_2PI * static_cast<double>(static_cast<int32_t>(dt * n_[k] / M_2PI));
+			}
+
+			// initial guess for the Kepler solver
+			sincos_lanes(dM, sindE, cosdE);
+
+			KERNELS_SIMD_LOOP
+			for (size_t k = 0; k < LANES; k++)
+			{
+				dE[k] = dM[k] - esinEo[k] + esinEo[k] * cosdE[k] + ecosEo[k] * sindE[k];
+			}
+
+			if (fixed)
+			{
+				kepeq_fixed_lanes(dM, ecosEo, esinEo, dE, sindE, cosdE, done, maxkep);
+			}
+			else
+			{
+				kepeq_lanes(dM, ecosEo, esinEo, dE, sindE, cosdE, done, maxkep);
+			}
+
+			KERNELS_SIMD_LOOP
+			for (size_t k = 0; k < LANES; k++)
+			{
+				// remaining time to advance
+				double _dt = dM[k] / n_[k];
+
+				double fp = 1.0 - ecosEo[k] * cosdE[k] + esinEo[k] * sindE[k];
+				double f = 1.0 + a[k] * (cosdE[k] - 1.0) / dist[k];
+				double g = _dt + (sindE[k] - dE[k]) / n_[k];
+				double fdot = -n_[k] * sindE[k] * a[k] / (dist[k] * fp);
+				double gdot = 1.0 + (cosdE[k] - 1.0) / fp;
+
+				double x = rx[b + k], y = ry[b + k], z = rz[b + k];
+				double u = vx[b + k], v = vy[b + k], w = vz[b + k];
+
+				double nx = x * f + u * g, ny = y * f + v * g, nz = z * f + w * g;
+				double nu = x * fdot + u * gdot, nv = y * fdot + v * gdot, nw = z * fdot + w * gdot;
+
+				rx[b + k] = act[k] ? nx : x;
+				ry[b + k] = act[k] ? ny : y;
+				rz[b + k] = act[k] ? nz : z;
+				vx[b + k] = act[k] ? nu : u;
+				vy[b + k] = act[k] ? nv : v;
+				vz[b + k] = act[k] ? nw : w;
+			}
+
+			KERNELS_SIMD_LOOP
+			for (size_t k = 0; k < LANES; k++)
+			{
+				uint16_t unbound_flag = static_cast<uint16_t>((act[k] & unbound[k]) << 2);
+				uint16_t kepler_flag = static_cast<uint16_t>((done[k] ^ 1) << 3);
+				flags[b + k] = static_cast<uint16_t>(flags[b + k] | unbound_flag | kepler_flag);
+			}
+		}
+	}
+
+	/**
+	 * The body of `accelerate` and `accelerate_mixed`. With `mixed`, the term of a planet that every particle in the batch is far from,
+	 * with its squared distance above `far_ratio2` times the particle's squared heliocentric distance, is evaluated in single precision
+	 * and subtracted from the double precision sum. The distances themselves are always taken
+	 * in double precision, since they cancel, and so is the encounter test.
+	 */
+	template<uint32_t N, bool mixed>
+	void accelerate_planets(const double* rx, const double* ry, const double* rz, double* ax, double* ay, double* az, uint16_t* flags, const bool* active,
+			size_t n, uint32_t planet_n, const f64_3& h0, const f64_3* r_log_step, const double* m, const double* rh2, double far_ratio2)
+	{
+		// With a planet count specialization, copy the planet constants into locals that stay in registers across the batches
+		double m_local[N + 1], rh2_local[N + 1];
+		if (N)
+		{
+			for (uint32_t i = 0; i < N + 1; i++)
+			{
+				m_local[i] = m[i];
+				rh2_local[i] = rh2[i];
+			}
+
+			m = m_local;
+			rh2 = rh2_local;
+		}
+
+		for (size_t b = 0; b < n; b += LANES)
+		{
+			double lax[LANES], lay[LANES], laz[LANES], far_rad[LANES];
+			int64_t encounter[LANES];
+
+			KERNELS_SIMD_LOOP
+			for (size_t k = 0; k < LANES; k++)
+			{
+				lax[k] = h0.x;
+				lay[k] = h0.y;
+				laz[k] = h0.z;
+				encounter[k] = 0;
+				far_rad[k] = far_ratio2 * (rx[b + k] * rx[b + k] + ry[b + k] * ry[b + k] + rz[b + k] * rz[b + k]);
+			}
+
+			// planet 0 is not counted
+			UNROLL_PLANETS
+			for (uint32_t i = 1; i < (N ? N + 1 : planet_n); i++)
+			{
+				double px = r_log_step[i - 1].x, py = r_log_step[i - 1].y, pz = r_log_step[i - 1].z;
+				double rh2i = rh2[i];
+				double mi = m[i];
+
+				if (!mixed)
+				{
+					KERNELS_SIMD_LOOP
+					for (size_t k = 0; k < LANES; k++)
+					{
+						double dx = rx[b + k] - px, dy = ry[b + k] - py, dz = rz[b + k] - pz;
+						double rad = dx * dx + dy * dy + dz * dz;
+
+						// only the first planet that the particle is close to is recorded
+						encounter[k] = ((rad < rh2i) & (encounter[k] == 0)) ? i : encounter[k];
+
+						double inv3 = 1. / (rad * std::sqrt(rad));
+						double fac = mi * inv3;
+
+						lax[k] -= dx * fac;
+						lay[k] -= dy * fac;
+						laz[k] -= dz * fac;
+					}
+
+					continue;
+				}
+
+				double dx[LANES], dy[LANES], dz[LANES], rad[LANES];
+				int64_t all_far = 1;
+
+				KERNELS_SIMD_LOOP
+				for (size_t k = 0; k < LANES; k++)
+				{
+					dx[k] = rx[b + k] - px;
+					dy[k] = ry[b + k] - py;
+					dz[k] = rz[b + k] - pz;
+					rad[k] = dx[k] * dx[k] + dy[k] * dy[k] + dz[k] * dz[k];
+
+					encounter[k] = ((rad[k] < rh2i) & (encounter[k] == 0)) ? i : encounter[k];
+					all_far &= rad[k] > far_rad[k];
+				}
+
+				if (all_far)
+				{
+					float mf = static_cast<float>(mi);
+
+					KERNELS_SIMD_LOOP
+					for (size_t k = 0; k < LANES; k++)
+					{
+						float radf = static_cast<float>(rad[k]);
+						float fac = mf / (radf * std::sqrt(radf));
+
+						lax[k] -= static_cast<double>(static_cast<float>(dx[k]) * fac);
+						lay[k] -= static_cast<double>(static_cast<float>(dy[k]) * fac);
+						laz[k] -= static_cast<double>(static_cast<float>(dz[k]) * fac);
+					}
+				}
+				else
+				{
+					KERNELS_SIMD_LOOP
+					for (size_t k = 0; k < LANES; k++)
+					{
+						double inv3 = 1. / (rad[k] * std::sqrt(rad[k]));
+						double fac = mi * inv3;
+
+						lax[k] -= dx[k] * fac;
+						lay[k] -= dy[k] * fac;
+						laz[k] -= dz[k] * fac;
+					}
+				}
+			}
+
+			for (size_t k = 0; k < LANES; k++)
+			{
+				if (!active[b + k]) continue;
+
+				ax[b + k] = lax[k];
+				ay[b + k] = lay[k];
+				az[b + k] = laz[k];
+
+				uint16_t fl = flags[b + k];
+				if (encounter[k] && fl == 0)
+				{
+					fl = static_cast<uint16_t>((fl & 0x00FF) | (encounter[k] << 8) | 0x0001);
+				}
+
+				double rad = rx[b + k] * rx[b + k] + ry[b + k] * ry[b + k] + rz[b + k] * rz[b + k];
+				if (rad < rh2[0])
+				{
+					fl = static_cast<uint16_t>((fl & 0x00FF) | 0x0001);
+				}
+				if (rad > wh::OUT_OF_BOUNDS_RADIUS * wh::OUT_OF_BOUNDS_RADIUS)
+				{
+					fl = static_cast<uint16_t>(fl | 0x0002);
+				}
+
+				flags[b + k] = fl;
+			}
+		}
+	}
+
+	template<uint32_t N>
+	void accelerate(const double* rx, const double* ry, const double* rz, double* ax, double* ay, double* az, uint16_t* flags, const bool* active,
+			size_t n, uint32_t planet_n, const f64_3& h0, const f64_3* r_log_step, const double* m, const double* rh2)
+	{
+		accelerate_planets<N, false>(rx, ry, rz, ax, ay, az, flags, active, n, planet_n, h0, r_log_step, m, rh2, 0);
+	}
+
+	template<uint32_t N>
+	void accelerate_mixed(const double* rx, const double* ry, const double* rz, double* ax, double* ay, double* az, uint16_t* flags, const bool* active,
+			size_t n, uint32_t planet_n, const f64_3& h0, const f64_3* r_log_step, const double* m, const double* rh2, double far_ratio2)
+	{
+		accelerate_planets<N, true>(rx, ry, rz, ax, ay, az, flags, active, n, planet_n, h0, r_log_step, m, rh2, far_ratio2);
+	}
+
+	void to_elements_one(double mu, double x, double y, double z, double vx, double vy, double vz,
+			int* esignout, double* aout, double* eout, double* iout, double* capomout, double* omout, double* fout)
+	{
+		double a, e, i, capom, om, f;
+		int esign;
+
+		double pi, prec;
+		double hsq, hx, hy, hz;
+		double rr, xhat, yhat, zhat;
+		double vsq, vdotr, fac;
+		double Px, Py, Pz, modP, nx, ny, ecosw;
+		double energy;
+
+		pi = 2.0 * std::asin(1.0);
+		/* machine precision, user must set this */
+		prec = 1.0e-13;
+
+		/* compute the specific angular momentum */
+		hx = y * vz - z * vy;
+		hy = z * vx - x * vz;
+		hz = x * vy - y * vx;
+		hsq = hx * hx + hy * hy + hz * hz;
+
+		/* As long as we are not on a radial orbit, compute elements */
+		if (hsq > prec)
+		{
+			/* compute the orbital inclination */
+			i = std::acos(hz / std::sqrt(hsq));
+
+			/* compute the longitude of the ascending node */
+			if (std::fabs(i) < prec) {
+				capom = 0.0;
+			}
+			else if (std::fabs(pi - std::fabs(i)) < prec) {
+				capom = 0.0;
+			}
+			else {
+				capom = std::atan2(hx, -hy);
+			}
+
+			/* compute some required quantities */
+			vsq = vx * vx + vy * vy + vz * vz;
+			vdotr = x * vx + y * vy + z * vz;
+			rr = std::sqrt(x * x + y * y + z * z);
+			xhat = x / rr;
+			yhat = y / rr;
+			zhat = z / rr;
+			nx = std::cos(capom);
+			ny = std::sin(capom);
+
+			/* compute the Hamilton vector and thus the eccentricity */
+			fac = vsq * rr - mu;
+			Px = fac * xhat - vdotr * vx;
+			Py = fac * yhat - vdotr * vy;
+			Pz = fac * zhat - vdotr * vz;
+			modP = std::sqrt(Px * Px + Py * Py + Pz * Pz);
+			e = modP / mu;
+
+			/* compute the argument of pericenter */
+			if (std::fabs(e) < prec) {
+				om = 0.0;
+			}
+			else {
+				if ((i < prec) || (pi - i < prec)) {
+					om = std::atan2(Py, Px);
+				} else {
+					ecosw = (nx * Px + ny * Py) / mu;
+					om = std::acos(ecosw / e);
+					if (std::fabs(Pz) > prec) {
+						/* resolve sign ambiguity by sign of Pz  */
+						om *= std::fabs(Pz) / Pz;
+					}
+				}
+			}
+
+			/* compute the orbital energy , and depending on its sign compute
+			   the semimajor axis (or pericenter) and true anomaly      */
+			energy = vsq / 2.0 - mu / rr;
+			if (std::fabs(energy) < prec) {
+				esign = 0;		/* parabolic */
+				a = 0.5 * hsq / mu;	/* actually PERICENTRIC DISTANCE */
+				if (std::fabs(vdotr) < prec) {
+					f = 0.0;
+				} else {
+					f = 2.0 * std::acos(std::sqrt(a / rr)) * vdotr / std::fabs(vdotr);
+				}
+			} else if (energy > 0.0) {
+				esign = 1;		/* hyperbolic */
+				a = -0.5 * mu / energy;  /* will be negative */
+
+				if (std::fabs(vdotr) < prec) {
+					f = 0.0;
+				} else {
+					fac = a * (1.0 - e * e) / rr - 1.0;
+					f = std::acos(fac / e) * vdotr / std::fabs(vdotr);
+				}
+			} else {
+				esign = -1;		/* elliptic */
+				a = -0.5 * mu / energy;
+				if (std::fabs(e) > prec) {
+					if (std::fabs(vdotr) < prec) {
+						if (rr < a) {		/* determine apside */
+							f = 0.0;
+						} else {
+							f = pi;
+						}
+					} else {
+						fac = a * (1.0 - e * e) / rr - 1.0;
+						f = std::acos(fac / e) * vdotr / std::fabs(vdotr);
+					}
+				} else {                       /* compute circular cases */
+					fac = (x * nx + y * ny) / rr;
+					f = std::acos(fac);
+					if (std::fabs(z) > prec) {
+						/* resolve sign ambiguity by sign of z  */
+						f *= std::fabs(z) / z;
+					} else if ((i < prec) || (pi - i < prec)) {
+						f = std::atan2(y, x) * std::cos(i);
+					}
+				}
+			}
+		} else { 				/* PANIC: radial orbit */
+			esign = 1;			/* call it hyperbolic */
+			a = std::sqrt(x * x + y * y + z * z);
+			e = HUGE_VAL;
+			i = std::asin(z / std::sqrt(x * x + y * y + z * z));	/* latitude above plane */
+			capom = std::atan2(y, x);			/* azimuth */
+			om = HUGE_VAL;
+			f = HUGE_VAL;
+		}
+
+		if (esignout) *esignout = esign;
+		if (aout) *aout = a;
+		if (eout) *eout = e;
+		if (iout) *iout = i;
+		if (capomout) *capomout = capom;
+		if (omout) *omout = om;
+		if (fout) *fout = f;
+	}
+
+	void to_elements(double mu, const double* rx, const double* ry, const double* rz, const double* vx, const double* vy, const double* vz,
+			size_t n, int* esign, double* a, double* e, double* i, double* capom, double* om, double* f)
+	{
+		for (size_t k = 0; k < n; k++)
+		{
+			to_elements_one(mu, rx[k], ry[k], rz[k], vx[k], vy[k], vz[k],
+					esign ? esign + k : nullptr, a ? a + k : nullptr, e ? e + k : nullptr, i ? i + k : nullptr,
+					capom ? capom + k : nullptr, om ? om + k : nullptr, f ? f + k : nullptr);
+		}
+	}
+
+	size_t compact(const uint16_t* flags, uint32_t* indices, size_t n)
+	{
+		// Always store, and only advance past the entries that are kept
+		size_t kept = 0;
+		for (size_t k = 0; k < n; k++)
+		{
+			uint32_t index = indices[k];
+			indices[kept] = index;
+			kept += flags[index] == 0;
+		}
+
+		return kept;
+	}
+
+#ifndef KERNELS_VECTOR_PARTITION
+	size_t partition(const uint16_t* flags, uint16_t mask, size_t* indices, size_t n)
+	{
+		size_t kept = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			kept += (flags[i] & mask) == 0;
+		}
+
+		// The store address is selected rather than branched on, since the flags are unpredictable
+		size_t front = 0, back = kept;
+		for (size_t i = 0; i < n; i++)
+		{
+			bool keep = (flags[i] & mask) == 0;
+			indices[keep ? front : back] = i;
+			front += keep;
+			back += !keep;
+		}
+
+		return kept;
+	}
+#endif
+
+	static_assert(wh::MAX_SPECIALIZED_PLANETS == 16, "the acceleration kernel tables list one entry per planet count specialization");
+
+	const KernelSet::Accelerate accelerate_kernels[wh::MAX_SPECIALIZED_PLANETS + 1] =
+	{
+		&accelerate<0>, &accelerate<1>, &accelerate<2>, &accelerate<3>, &accelerate<4>, &accelerate<5>, &accelerate<6>, &accelerate<7>, &accelerate<8>,
+		&accelerate<9>, &accelerate<10>, &accelerate<11>, &accelerate<12>, &accelerate<13>, &accelerate<14>, &accelerate<15>, &accelerate<16>
+	};
+
+	const KernelSet::AccelerateMixed accelerate_mixed_kernels[wh::MAX_SPECIALIZED_PLANETS + 1] =
+	{
+		&accelerate_mixed<0>, &accelerate_mixed<1>, &accelerate_mixed<2>, &accelerate_mixed<3>, &accelerate_mixed<4>, &accelerate_mixed<5>,
+		&accelerate_mixed<6>, &accelerate_mixed<7>, &accelerate_mixed<8>, &accelerate_mixed<9>, &accelerate_mixed<10>, &accelerate_mixed<11>,
+		&accelerate_mixed<12>, &accelerate_mixed<13>, &accelerate_mixed<14>, &accelerate_mixed<15>, &accelerate_mixed<16>
+	};
+}
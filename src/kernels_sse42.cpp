@@ -0,0 +1,29 @@
+#include "kernels.h"
+#include "mvs_kernel.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#pragma GCC push_options
+#pragma GCC target("sse4.2,popcnt")
+
+namespace sr
+{
+namespace kernels
+{
+namespace sse42
+{
+	using wh::TOLKEP;
+
+#define KERNELS_SIMD_LOOP
+#include "kernels_impl.h"
+#undef KERNELS_SIMD_LOOP
+
+	const KernelSet kernel_set = { Isa::SSE42, "sse4.2", &drift<false>, &drift<true>, accelerate_kernels, accelerate_mixed_kernels, &to_elements, &compact, &partition };
+}
+}
+}
+
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,275 @@
+#pragma once
+#include "types.h"
+#include <cmath>
+
+namespace sr
+{
+namespace wh
+{
+	const float64_t TOLKEP = 1E-14;
+
+	/**
+	 * The heliocentric distance beyond which a particle is flagged as out of bounds (0x02).
+	 * Every engine uses it, so that they all agree on which particles survive.
+	 */
+	const float64_t OUT_OF_BOUNDS_RADIUS = 2000;
+
+	/**
+	 * The largest number of planets, not counting the sun, that the acceleration kernels are specialized for.
+	 * A kernel specialized for `N` planets takes `N` as a template parameter, which lets the compiler fully unroll
+	 * the loop over the planets and keep the planet masses and close encounter radii in registers.
+	 * `N` = 0 is the generic kernel, which reads the planet count at runtime.
+	 */
+	const uint32_t MAX_SPECIALIZED_PLANETS = 16;
+
+	/** Unrolls the loop that follows over the planets, for kernels that are specialized on the planet count. */
+#ifdef __CUDA_ARCH__
+#define UNROLL_PLANETS _Pragma("unroll")
+#else
+#define UNROLL_PLANETS _Pragma("GCC unroll 16")
+#endif
+
+	/** Gets the specialization for `planet_n` bodies, including the sun: the number of planets, or 0 if there is no specialized kernel. */
+	__host__ __device__
+	inline uint32_t specialized_planets(uint32_t planet_n)
+	{
+		return planet_n >= 2 && planet_n - 1 <= MAX_SPECIALIZED_PLANETS ? planet_n - 1 : 0;
+	}
+
+	/** Gets the number of bodies, including the sun, that a kernel specialized for `N` planets loops over. */
+	template<uint32_t N>
+	__host__ __device__
+	inline uint32_t planet_count(uint32_t planet_n)
+	{
+		return N ? N + 1 : planet_n;
+	}
+
+	template<uint32_t N, typename F>
+	struct PlanetCountDispatch
+	{
+		static void run(uint32_t specialization, F& f)
+		{
+			if (specialization == N) f.template run<N>();
+			else PlanetCountDispatch<N + 1, F>::run(specialization, f);
+		}
+	};
+
+	template<typename F>
+	struct PlanetCountDispatch<MAX_SPECIALIZED_PLANETS, F>
+	{
+		static void run(uint32_t specialization, F& f)
+		{
+			if (specialization == MAX_SPECIALIZED_PLANETS) f.template run<MAX_SPECIALIZED_PLANETS>();
+			else f.template run<0>();
+		}
+	};
+
+	/**
+	 * Calls `f.template run<N>()` with the specialization for `planet_n` bodies, see `specialized_planets`.
+	 * Meant to be called once per timeblock, outside of the loops over the particles.
+	 */
+	template<typename F>
+	void dispatch_planet_count(uint32_t planet_n, F& f)
+	{
+		PlanetCountDispatch<1, F>::run(specialized_planets(planet_n), f);
+	}
+
+	/**
+	 * The per-particle MVS integration kernel, shared between the CUDA particle integrator
+	 * and the particle-major CPU engine so that the two backends cannot diverge.
+	 * All of the functions here are callable from both the host and the device.
+	 */
+	struct MVSKernelBase
+	{
+		__host__ __device__
+		static void kepeq(double dM, double ecosEo, double esinEo, double* dE, double* sindE, double* cosdE, uint16_t& flags, uint32_t maxkep)
+		{
+			double f, fp, delta;
+
+			*sindE = sin(*dE);
+			*cosdE = cos(*dE);
+
+			for (size_t i = 0; i < maxkep; i++)
+			{
+				f = *dE - ecosEo * (*sindE) + esinEo * (1. - *cosdE) - dM;
+				fp = 1. - ecosEo * (*cosdE) + esinEo * (*sindE);
+				delta = -f / fp;
+
+				*dE += delta;
+				*sindE = sin(*dE);
+				*cosdE = cos(*dE);
+
+				// Fixed iterations avoid warp divergence on the GPU, but on the CPU the early exit is much cheaper
+#if defined(CUDA_KEPEQ_CHECK_CONVERGENCE) || !defined(__CUDA_ARCH__)
+				if (fabs(delta) < TOLKEP)
+				{
+					goto done;
+				}
+#endif
+			}
+
+			flags = static_cast<uint16_t>(flags | ((fabs(delta) > TOLKEP) << 3));
+done: ;
+		}
+
+		__host__ __device__
+		static void drift(f64_3& r, f64_3& v, uint16_t& flags, double dt, double mu, uint32_t maxkep)
+		{
+			float64_t dist = sqrt(r.lensq());
+			float64_t vdotr = v.x * r.x + v.y * r.y + v.z * r.z;
+
+			float64_t energy = v.lensq() * 0.5 - mu / dist;
+
+			flags = static_cast<uint16_t>(flags | ((energy >= 0) << 2));
+
+			float64_t a = -0.5 * mu / energy;
+			float64_t n_ = sqrt(mu / (a * a * a));
+			float64_t ecosEo = 1.0 - dist / a;
+			float64_t esinEo = vdotr / (n_ * a * a);
+
+			// subtract off an integer multiple of complete orbits
+			float64_t dM = dt * n_ - M_2PI * (int) (dt * n_ / M_2PI);
+
+			// remaining time to advance
+			float64_t _dt = dM / n_;
+
+			// call kepler equation solver with initial guess in dE already
+			float64_t dE = dM - esinEo + esinEo * cos(dM) + ecosEo * sin(dM);
+			float64_t sindE, cosdE;
+			kepeq(dM, ecosEo, esinEo, &dE, &sindE, &cosdE, flags, maxkep);
+
+			float64_t fp = 1.0 - ecosEo * cosdE + esinEo * sindE;
+			float64_t f = 1.0 + a * (cosdE - 1.0) / dist;
+			float64_t g = _dt + (sindE - dE) / n_;
+			float64_t fdot = -n_ * sindE * a / (dist * fp);
+			float64_t gdot = 1.0 + (cosdE - 1.0) / fp;
+
+			f64_3 r0 = r;
+			r = r0 * f + v * g;
+			v = r0 * fdot + v * gdot;
+		}
+
+		/** Adds the acceleration from planet `i` to `a`, and flags a close encounter with it. */
+		__host__ __device__
+		static void accelerate_planet(uint32_t i, const f64_3& r, f64_3& a, uint16_t& flags,
+				const f64_3* r_log_step, const float64_t* m, const float64_t* rh2)
+		{
+			f64_3 dr = r - r_log_step[i - 1];
+
+			float64_t rad = dr.lensq();
+
+			if (rad < rh2[i] && flags == 0)
+			{
+				flags = flags & 0x00FF;
+				flags = static_cast<uint16_t>(flags | (i << 8) | 0x0001);
+			}
+
+			float64_t inv3 = 1. / (rad * sqrt(rad));
+			float64_t fac = m[i] * inv3;
+
+			a -= dr * fac;
+		}
+
+		/**
+		 * Computes the heliocentric acceleration on a particle at `r` from the planets in one timestep of the planet log,
+		 * and flags the particle if it is too close to a planet or the sun, or out of bounds.
+		 * `rh2` holds the squared close encounter radii. `N` is the planet count specialization, see `MAX_SPECIALIZED_PLANETS`.
+		 */
+		template<uint32_t N>
+		__host__ __device__
+		static void accelerate(const f64_3& r, f64_3& a, uint16_t& flags, uint32_t planet_n,
+				const f64_3& h0, const f64_3* r_log_step, const float64_t* m, const float64_t* rh2)
+		{
+			a = h0;
+
+			// planet 0 is not counted. The unroll pragma needs a trip count known at compile time, so only the specialized loop has it
+			if (N != 0)
+			{
+				UNROLL_PLANETS
+				for (uint32_t i = 1; i < N + 1; i++)
+				{
+					accelerate_planet(i, r, a, flags, r_log_step, m, rh2);
+				}
+			}
+			else
+			{
+				for (uint32_t i = 1; i < planet_n; i++)
+				{
+					accelerate_planet(i, r, a, flags, r_log_step, m, rh2);
+				}
+			}
+
+			float64_t rad = r.lensq();
+			if (rad < rh2[0])
+			{
+				flags = flags & 0x00FF;
+				flags = flags | 0x0001;
+			}
+			if (rad > OUT_OF_BOUNDS_RADIUS * OUT_OF_BOUNDS_RADIUS)
+			{
+				flags = flags | 0x0002;
+			}
+		}
+
+		/**
+		 * The planet masses and squared close encounter radii that `step_forward` passes to `accelerate`.
+		 * With a planet count specialization they are copied into local arrays, which the compiler keeps in registers
+		 * for the whole timeblock once the loops over the planets are unrolled.
+		 */
+		template<uint32_t N>
+		struct PlanetConstants
+		{
+			float64_t m[N + 1], rh2[N + 1];
+
+			__host__ __device__
+			PlanetConstants(const float64_t* _m, const float64_t* _rh2)
+			{
+				UNROLL_PLANETS
+				for (uint32_t i = 0; i < N + 1; i++)
+				{
+					m[i] = _m[i];
+					rh2[i] = _rh2[i];
+				}
+			}
+		};
+
+		template<uint32_t N>
+		__host__ __device__
+		static void step_forward(f64_3& r, f64_3& v, uint16_t& flags, f64_3& a, uint32_t& deathtime_index, uint32_t _tbsize,
+				uint32_t planet_n, const f64_3* h0_log, const f64_3* r_log, const float64_t* m, const float64_t* rh2, float64_t dt, float64_t mu, uint32_t maxkep)
+		{
+			PlanetConstants<N> planets(m, rh2);
+
+			deathtime_index = 0;
+
+			for (uint32_t step = 0; step < static_cast<uint32_t>(_tbsize); step++)
+			{
+				if (flags == 0)
+				{
+					// kick
+					v = v + a * (dt / 2);
+
+					drift(r, v, flags, dt, mu, maxkep);
+
+					accelerate<N>(r, a, flags, planet_n, h0_log[step], r_log + step * (planet_n - 1), planets.m, planets.rh2);
+
+					v = v + a * (dt / 2);
+
+					deathtime_index = step + 1;
+				}
+			}
+		}
+	};
+
+	/** Without a planet count specialization, the planet constants are read through the pointers. */
+	template<>
+	struct MVSKernelBase::PlanetConstants<0>
+	{
+		const float64_t* m;
+		const float64_t* rh2;
+
+		__host__ __device__
+		PlanetConstants(const float64_t* _m, const float64_t* _rh2) : m(_m), rh2(_rh2) { }
+	};
+}
+}
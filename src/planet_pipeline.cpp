@@ -0,0 +1,105 @@
+#include "planet_pipeline.h"
+
+namespace sr
+{
+namespace exec
+{
+	PlanetPipeline::PlanetPipeline() : head(0), count(0), stopping(false) { }
+
+	PlanetPipeline::~PlanetPipeline()
+	{
+		stop();
+	}
+
+	void PlanetPipeline::start(size_t depth, const PlanetTimeblock& prototype, const Producer& _producer)
+	{
+		stop();
+
+		slots = std::vector<PlanetTimeblock>(depth, prototype);
+		head = 0;
+		count = 0;
+		stopping = false;
+		error = nullptr;
+		producer = _producer;
+
+		thread = std::thread(&PlanetPipeline::producer_main, this);
+	}
+
+	PlanetTimeblock& PlanetPipeline::acquire()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		ready_cv.wait(lock, [this]() { return count > 0 || error; });
+
+		// Timeblocks that finished before the error are still good
+		if (count == 0)
+		{
+			std::rethrow_exception(error);
+		}
+
+		return slots[head];
+	}
+
+	void PlanetPipeline::release()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			head = (head + 1) % slots.size();
+			count--;
+		}
+
+		free_cv.notify_one();
+	}
+
+	void PlanetPipeline::stop()
+	{
+		if (!thread.joinable()) return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		free_cv.notify_one();
+		thread.join();
+	}
+
+	void PlanetPipeline::producer_main()
+	{
+		size_t tail = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				free_cv.wait(lock, [this]() { return stopping || count < slots.size(); });
+
+				if (stopping) return;
+			}
+
+			// The slot at `tail` is neither in the ring nor held by the consumer, so it is written outside the lock
+			try
+			{
+				producer(slots[tail]);
+			}
+			catch (...)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					error = std::current_exception();
+				}
+
+				ready_cv.notify_one();
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				count++;
+			}
+
+			ready_cv.notify_one();
+			tail = (tail + 1) % slots.size();
+		}
+	}
+}
+}
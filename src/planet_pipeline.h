@@ -0,0 +1,90 @@
+#pragma once
+#include "data.h"
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sr
+{
+namespace exec
+{
+	using namespace sr::data;
+
+	/** Everything the particles need from the planets for one timeblock. */
+	struct PlanetTimeblock
+	{
+		/** The time at the start and at the end of the timeblock. */
+		float64_t t, t_end;
+
+		/** The number of steps in the timeblock, at most `Time-Block-Size`. */
+		uint32_t steps;
+
+		/** Whether the timeblock ends a whole interval of `Time-Block-Size` steps. Always true unless `Adaptive-Time-Block` is on. */
+		bool ends_interval;
+
+		/** The planets at the end of the timeblock. */
+		HostPlanetSnapshot planets;
+
+		/** The planet logs, laid out as in `HostPlanetPhaseSpace`, and the log of the acceleration of the sun. */
+		Vf64_3 r_log, v_log, h0_log;
+	};
+
+	/**
+	 * Runs the planet integration on a dedicated thread, which produces timeblocks into a ring buffer
+	 * up to `depth` timeblocks ahead of the consumer. The consumer takes the timeblocks in order with `acquire()`
+	 * and hands each slot back with `release()` when it no longer reads from it.
+	 * Rather than copying the logs in and out of a slot, both sides swap them with their own log vectors,
+	 * so the same vectors rotate between the producer, the ring and the consumer.
+	 */
+	class PlanetPipeline
+	{
+	public:
+		/**
+		 * Integrates the planets through the next timeblock and stores it in `block`, swapping the logs in.
+		 * Called from the planet thread only.
+		 */
+		using Producer = std::function<void(PlanetTimeblock& block)>;
+
+		PlanetPipeline();
+		~PlanetPipeline();
+
+		PlanetPipeline(const PlanetPipeline&) = delete;
+		PlanetPipeline& operator=(const PlanetPipeline&) = delete;
+
+		/** Fills the ring with `depth` copies of `prototype` and starts the planet thread. */
+		void start(size_t depth, const PlanetTimeblock& prototype, const Producer& producer);
+
+		/**
+		 * Blocks until the next timeblock is ready and returns it. If the producer threw an exception,
+		 * it is rethrown here instead.
+		 */
+		PlanetTimeblock& acquire();
+
+		/** Hands the slot of the last `acquire()` back to the planet thread. */
+		void release();
+
+		/** Stops the planet thread after the timeblock it is working on. Timeblocks in the ring are discarded. */
+		void stop();
+
+	private:
+		void producer_main();
+
+		std::vector<PlanetTimeblock> slots;
+
+		/** The slot that `acquire()` returns next, and the number of slots that are produced but not yet released. */
+		size_t head, count;
+
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable ready_cv, free_cv;
+
+		bool stopping;
+		std::exception_ptr error;
+
+		Producer producer;
+	};
+}
+}
@@ -0,0 +1,185 @@
+#include "sia4.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+namespace sr
+{
+namespace sia4
+{
+	using namespace sr::data;
+	using namespace sr::wh;
+
+	namespace
+	{
+		/** Steps particles through a timeblock with the planet count specialization picked by `dispatch_planet_count`. */
+		struct ParticleTimeblock
+		{
+			SIA4Integrator& integrator;
+			const HostPlanetPhaseSpace& pl;
+			HostParticlePhaseSpace& pa;
+			size_t begin, length;
+
+			template<uint32_t N>
+			void run()
+			{
+				integrator.step_particles<N>(pl, pa, begin, length);
+			}
+		};
+	}
+
+	SIA4Integrator::SIA4Integrator() { }
+	SIA4Integrator::SIA4Integrator(HostPlanetPhaseSpace& pl, const Configuration& config)
+	{
+		tbsize = config.tbsize;
+		dt = config.dt;
+
+		float64_t curt2 = std::cbrt(2.);
+
+		drift_dt[0] = drift_dt[3] = (2. + curt2 + 1. / curt2) / 6.;
+		drift_dt[1] = drift_dt[2] = (1. - curt2 - 1. / curt2) / 6.;
+		kick_dt[0] = 0;
+		kick_dt[1] = kick_dt[3] = 1. / (2. - curt2);
+		kick_dt[2] = 1. / (1. - curt2 * curt2);
+
+		for (size_t i = 0; i < SIA4_STAGES + 1; i++)
+		{
+			drift_dt[i] *= dt;
+			kick_dt[i] *= dt;
+		}
+
+		planet_a = Vf64_3(pl.n());
+		planet_h0_log = sr::util::LogQuartet<Vf64_3>(tbsize * SIA4_STAGES);
+
+		// As in WHIntegrator, there is no close encounter radius for the sun
+		planet_rh2 = Vf64(pl.n());
+		for (size_t i = 1; i < pl.n(); i++)
+		{
+			planet_rh2[i] = config.cull_radius * config.cull_radius;
+		}
+
+		pl.r_log() = sr::util::LogQuartet<Vf64_3>((pl.n() - 1) * tbsize * SIA4_STAGES);
+	}
+
+	void SIA4Integrator::swap_logs()
+	{
+		planet_h0_log.swap_logs();
+	}
+
+	void SIA4Integrator::helio_acc_planets(const HostPlanetPhaseSpace& pl, f64_3& h0)
+	{
+		const size_t n = pl.n_alive();
+		h0 = f64_3(0);
+
+		for (size_t i = 1; i < n; i++)
+		{
+			float64_t r2 = pl.r()[i].lensq();
+			float64_t inv3 = 1. / (r2 * std::sqrt(r2));
+
+			planet_a[i] = pl.r()[i] * (-pl.m()[0] * inv3);
+			h0 -= pl.r()[i] * (pl.m()[i] * inv3);
+		}
+
+		for (size_t i = 1; i < n; i++)
+		{
+			planet_a[i] += h0;
+
+			for (size_t j = i + 1; j < n; j++)
+			{
+				f64_3 dr = pl.r()[i] - pl.r()[j];
+				float64_t r2 = dr.lensq();
+				float64_t inv3 = 1. / (r2 * std::sqrt(r2));
+
+				planet_a[i] -= dr * (pl.m()[j] * inv3);
+				planet_a[j] += dr * (pl.m()[i] * inv3);
+			}
+		}
+	}
+
+	void SIA4Integrator::integrate_planets_timeblock(HostPlanetPhaseSpace& pl, float64_t)
+	{
+		const size_t n = pl.n_alive();
+		Vf64_3& r_log = pl.r_log().old;
+		Vf64_3& h0_log = planet_h0_log.old;
+
+		for (size_t step = 0; step < tbsize; step++)
+		{
+			for (size_t i = 1; i < n; i++)
+			{
+				pl.r()[i] += pl.v()[i] * drift_dt[0];
+			}
+
+			for (size_t stage = 0; stage < SIA4_STAGES; stage++)
+			{
+				size_t log_index = step * SIA4_STAGES + stage;
+				std::copy(pl.r().begin() + 1, pl.r().begin() + static_cast<ptrdiff_t>(n), r_log.begin() + static_cast<ptrdiff_t>(log_index * (n - 1)));
+
+				helio_acc_planets(pl, h0_log[log_index]);
+
+				for (size_t i = 1; i < n; i++)
+				{
+					pl.v()[i] += planet_a[i] * kick_dt[stage + 1];
+					pl.r()[i] += pl.v()[i] * drift_dt[stage + 1];
+				}
+			}
+		}
+	}
+
+	void SIA4Integrator::integrate_particles_timeblock(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length, float64_t)
+	{
+		if (pa.deathtime_index().empty())
+		{
+			throw std::invalid_argument("Deathtime index array not allocated");
+		}
+
+		ParticleTimeblock timeblock = { *this, pl, pa, begin, length };
+		dispatch_planet_count(static_cast<uint32_t>(pl.n_alive()), timeblock);
+	}
+
+	template<uint32_t N>
+	void SIA4Integrator::step_particles(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length)
+	{
+		const uint32_t planet_n = static_cast<uint32_t>(pl.n_alive());
+		const f64_3* r_log = pl.r_log().get<false>().data();
+		const f64_3* h0_log = planet_h0_log.get<false>().data();
+		const float64_t mu = pl.m()[0];
+		MVSKernelBase::PlanetConstants<N> planets(pl.m().data(), planet_rh2.data());
+
+		for (size_t i = begin; i < begin + length; i++)
+		{
+			f64_3 r = pa.r()[i], v = pa.v()[i];
+			uint16_t flags = pa.deathflags()[i];
+			uint32_t deathtime_index = 0;
+
+			for (uint32_t step = 0; step < tbsize && flags == 0; step++)
+			{
+				r += v * drift_dt[0];
+
+				for (uint32_t stage = 0; stage < SIA4_STAGES; stage++)
+				{
+					size_t log_index = step * SIA4_STAGES + stage;
+
+					// The interaction with the planets, the indirect term and the close encounter checks are the same as for WH,
+					// only the Kepler term is added here
+					f64_3 a;
+					MVSKernelBase::accelerate<N>(r, a, flags, planet_n, h0_log[log_index], r_log + log_index * (planet_n - 1), planets.m, planets.rh2);
+
+					float64_t r2 = r.lensq();
+					a -= r * (mu / (r2 * std::sqrt(r2)));
+
+					v += a * kick_dt[stage + 1];
+					r += v * drift_dt[stage + 1];
+				}
+
+				deathtime_index = step + 1;
+			}
+
+			pa.r()[i] = r;
+			pa.v()[i] = v;
+			pa.deathflags()[i] = flags;
+			pa.deathtime_index()[i] = deathtime_index;
+		}
+	}
+}
+}
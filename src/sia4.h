@@ -0,0 +1,59 @@
+#pragma once
+#include "data.h"
+#include "util.h"
+#include "mvs_kernel.h"
+
+namespace sr
+{
+namespace sia4
+{
+	using namespace sr::data;
+
+	/** The number of force evaluations, and so planet log entries per planet, in one SIA4 timestep. */
+	const size_t SIA4_STAGES = 3;
+
+	/**
+	 * The fourth-order symplectic integrator of Forest & Ruth (1990) and Yoshida (1990): three kicks and four drifts per timestep,
+	 * with no Kepler solver. Planets and particles are integrated in heliocentric coordinates: with the acceleration of the sun
+	 * subtracted from every body, this is exactly the barycentric scheme, shifted along with the sun.
+	 *
+	 * Works like `sr::wh::WHIntegrator`: the planets are integrated one timeblock ahead into the planet log,
+	 * which then holds `SIA4_STAGES` entries per timestep, and the particles are integrated against it.
+	 */
+	class SIA4Integrator
+	{
+	public:
+		/** The coefficients of the drifts and kicks, multiplied by the timestep. `kick_dt[0]` is unused. */
+		float64_t drift_dt[SIA4_STAGES + 1], kick_dt[SIA4_STAGES + 1];
+
+		/** The acceleration of the sun, which every body feels in heliocentric coordinates, at each stage of the timeblock. */
+		sr::util::LogQuartet<Vf64_3> planet_h0_log;
+
+		Vf64_3 planet_a;
+
+		/** The squared close encounter radii, see `sr::wh::WHIntegrator::planet_rh2`. */
+		Vf64 planet_rh2;
+
+		size_t tbsize;
+		double dt;
+
+		SIA4Integrator();
+
+		/** Resizes the planet logs in `pl` to hold every stage of a timeblock. */
+		SIA4Integrator(HostPlanetPhaseSpace& pl, const Configuration& config);
+
+		void swap_logs();
+
+		void integrate_planets_timeblock(HostPlanetPhaseSpace& pl, float64_t t);
+
+		/** Integrates particles through the timeblock one at a time, and sets their death time index like `sr::wh::WHIntegrator::step_particles`. */
+		void integrate_particles_timeblock(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length, float64_t t);
+
+		/** Computes `planet_a` from the current planet positions, and the acceleration of the sun `h0`. */
+		void helio_acc_planets(const HostPlanetPhaseSpace& pl, f64_3& h0);
+
+		template<uint32_t N>
+		void step_particles(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length);
+	};
+}
+}
@@ -0,0 +1,161 @@
+#include "text_cursor.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace sr
+{
+namespace util
+{
+	namespace
+	{
+		/** Longer than any number that a state file holds, which `save_data` writes with 17 significant digits. */
+		const size_t MAX_NUMBER_LENGTH = 64;
+
+		inline bool is_space(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+		}
+
+		inline bool is_number_char(char c)
+		{
+			return (c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E';
+		}
+	}
+
+	TextCursor::TextCursor(const char* begin, const char* _end, const std::string* _path, size_t line)
+		: position(begin), end(_end), path(_path), _line(line) { }
+
+	size_t TextCursor::next_token(Across across)
+	{
+		while (position != end)
+		{
+			if (is_space(*position))
+			{
+				position++;
+			}
+			else if (*position == '\n' && across == Across::Lines)
+			{
+				position++;
+				_line++;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		if (position == end) fail("unexpected end of file");
+		if (*position == '\n') fail("unexpected end of line");
+
+		const char* token_end = position;
+		while (token_end != end && !is_space(*token_end) && *token_end != '\n') token_end++;
+
+		return static_cast<size_t>(token_end - position);
+	}
+
+	void TextCursor::number_token(Across across, char* buffer, size_t buffer_size)
+	{
+		size_t length = next_token(across);
+		if (length >= buffer_size) fail("expected a number, found " + std::string(position, length));
+
+		for (size_t i = 0; i < length; i++)
+		{
+			if (!is_number_char(position[i])) fail("expected a number, found " + std::string(position, length));
+		}
+
+		std::memcpy(buffer, position, length);
+		buffer[length] = '\0';
+		position += length;
+	}
+
+	double TextCursor::read_double(Across across)
+	{
+		char buffer[MAX_NUMBER_LENGTH];
+		number_token(across, buffer, sizeof(buffer));
+
+		char* parsed;
+		errno = 0;
+		double value = std::strtod(buffer, &parsed);
+
+		// Underflow gives the denormal or zero that strtod returns, as with std::istream; overflow is an error
+		if (*parsed != '\0' || parsed == buffer) fail(std::string("expected a number, found ") + buffer);
+		if (errno == ERANGE && std::isinf(value)) fail(std::string("number out of range: ") + buffer);
+
+		return value;
+	}
+
+	float TextCursor::read_float(Across across)
+	{
+		char buffer[MAX_NUMBER_LENGTH];
+		number_token(across, buffer, sizeof(buffer));
+
+		char* parsed;
+		errno = 0;
+		float value = std::strtof(buffer, &parsed);
+
+		if (*parsed != '\0' || parsed == buffer) fail(std::string("expected a number, found ") + buffer);
+		if (errno == ERANGE && std::isinf(value)) fail(std::string("number out of range: ") + buffer);
+
+		return value;
+	}
+
+	uint64_t TextCursor::read_unsigned(uint64_t max, Across across)
+	{
+		size_t length = next_token(across);
+
+		uint64_t value = 0;
+		for (size_t i = 0; i < length; i++)
+		{
+			char c = position[i];
+			if (c < '0' || c > '9') fail("expected an unsigned integer, found " + std::string(position, length));
+
+			uint64_t digit = static_cast<uint64_t>(c - '0');
+			if (value > (max - digit) / 10) fail("integer out of range: " + std::string(position, length));
+			value = value * 10 + digit;
+		}
+
+		position += length;
+		return value;
+	}
+
+	void TextCursor::skip_token(Across across)
+	{
+		position += next_token(across);
+	}
+
+	char TextCursor::peek(Across across)
+	{
+		next_token(across);
+		return *position;
+	}
+
+	void TextCursor::skip_line()
+	{
+		if (position == end) return;
+
+		const char* newline = static_cast<const char*>(std::memchr(position, '\n', static_cast<size_t>(end - position)));
+
+		if (newline)
+		{
+			position = newline + 1;
+			_line++;
+		}
+		else
+		{
+			position = end;
+		}
+	}
+
+	void TextCursor::fail(const std::string& what) const
+	{
+		std::ostringstream ss;
+		ss << *path << ":" << _line << ": " << what;
+		throw std::runtime_error(ss.str());
+	}
+}
+}
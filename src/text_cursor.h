@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sr
+{
+namespace util
+{
+	/**
+	 * Reads whitespace-separated tokens from text in memory, such as a `MappedFile`, keeping track of the line number
+	 * so that malformed input can be reported where it is. Numbers are converted as `std::istream` would convert them:
+	 * floating point values with the C library's correctly rounded `strtod` and `strtof`, which is what `std::num_get` calls.
+	 *
+	 * Every read either skips line breaks before the token (`Across::Lines`), as `>>` does, or fails if the line ends
+	 * first (`Across::None`), as `>>` on an `std::istringstream` of one line does. Cursors are cheap to copy, so a copy
+	 * can be handed to another thread to parse a later part of the text.
+	 */
+	class TextCursor
+	{
+	public:
+		enum class Across
+		{
+			None,
+			Lines
+		};
+
+		/** Starts reading at `begin`, which is on line `line` of the file at `path`. The path is only used in errors. */
+		TextCursor(const char* begin, const char* end, const std::string* path, size_t line = 1);
+
+		double read_double(Across across);
+		float read_float(Across across);
+
+		/** Reads an unsigned decimal integer, failing if it is greater than `max`. */
+		uint64_t read_unsigned(uint64_t max, Across across);
+
+		/** Skips a token without converting it. */
+		void skip_token(Across across);
+
+		/** Gets the first character of the next token without reading it, skipping line breaks before it. Fails at the end of the text. */
+		char peek(Across across);
+
+		/** Moves to the start of the next line, skipping whatever is left of this one. */
+		void skip_line();
+
+		inline size_t line() const { return _line; }
+
+		/** Throws an `std::runtime_error` that names the file and the current line. */
+		[[noreturn]] void fail(const std::string& what) const;
+
+	private:
+		const char* position;
+		const char* end;
+		const std::string* path;
+		size_t _line;
+
+		/** Skips whitespace up to the next token and returns its length. Fails if there is none. */
+		size_t next_token(Across across);
+
+		/** Copies the next token to a null-terminated buffer for the C library, checking that it only has number characters. */
+		void number_token(Across across, char* buffer, size_t buffer_size);
+	};
+}
+}
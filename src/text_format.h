@@ -0,0 +1,66 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace sr
+{
+namespace util
+{
+	/** Enough room for any number that the `format_*` functions write. */
+	const size_t MAX_FORMATTED_LENGTH = 32;
+
+	/**
+	 * Writes the shortest decimal that `strtod` reads back as exactly `value`, and returns its length. No terminator is written.
+	 * Values with a decimal exponent in [-5, 17) are written in fixed notation, others in scientific notation like `printf`'s %e.
+	 */
+	size_t format_double(double value, char* out);
+
+	/** Writes the shortest decimal that `strtof` reads back as exactly `value`, as `format_double` does. */
+	size_t format_float(float value, char* out);
+
+	size_t format_unsigned(uint64_t value, char* out);
+
+	/**
+	 * Text built up in memory with the `format_*` functions, to be written out in one piece. Several buffers can be
+	 * filled on different threads and written one after another.
+	 */
+	class TextBuffer
+	{
+	public:
+		inline void append(double value)
+		{
+			char buffer[MAX_FORMATTED_LENGTH];
+			text.append(buffer, format_double(value, buffer));
+		}
+
+		inline void append(float value)
+		{
+			char buffer[MAX_FORMATTED_LENGTH];
+			text.append(buffer, format_float(value, buffer));
+		}
+
+		inline void append_unsigned(uint64_t value)
+		{
+			char buffer[MAX_FORMATTED_LENGTH];
+			text.append(buffer, format_unsigned(value, buffer));
+		}
+
+		inline void append(char c) { text.push_back(c); }
+		inline void append(const char* s) { text.append(s); }
+
+		inline void reserve(size_t size) { text.reserve(size); }
+		inline void clear() { text.clear(); }
+		inline size_t size() const { return text.size(); }
+
+		inline void write_to(std::ostream& out) const
+		{
+			out.write(text.data(), static_cast<std::streamsize>(text.size()));
+		}
+
+	private:
+		std::string text;
+	};
+}
+}
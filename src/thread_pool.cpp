@@ -0,0 +1,146 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace sr
+{
+namespace util
+{
+	ThreadPool::ThreadPool(size_t num_threads) :
+		generation(0), running(0), stopping(false), range_begin(0), range_end(0), chunk_size(1)
+	{
+		if (num_threads == 0)
+		{
+			num_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		queues = std::unique_ptr<ChunkQueue[]>(new ChunkQueue[num_threads]);
+		for (size_t i = 0; i < num_threads; i++)
+		{
+			queues[i].next = 0;
+			queues[i].end = 0;
+		}
+
+		for (size_t i = 0; i < num_threads; i++)
+		{
+			threads.emplace_back(&ThreadPool::worker_main, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		start_cv.notify_all();
+
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	void ThreadPool::launch(size_t begin, size_t end, size_t chunk, const Task& _task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			task = _task;
+			range_begin = begin;
+			range_end = std::max(begin, end);
+			chunk_size = std::max<size_t>(chunk, 1);
+			error = nullptr;
+
+			// Each worker starts with an equal share of the chunks
+			size_t num_chunks = (range_end - range_begin + chunk_size - 1) / chunk_size;
+			for (size_t i = 0; i < size(); i++)
+			{
+				queues[i].next.store(num_chunks * i / size(), std::memory_order_relaxed);
+				queues[i].end = num_chunks * (i + 1) / size();
+			}
+
+			running = size();
+			generation++;
+		}
+
+		start_cv.notify_all();
+	}
+
+	void ThreadPool::wait()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done_cv.wait(lock, [this]() { return running == 0; });
+
+		if (error)
+		{
+			std::exception_ptr e = error;
+			error = nullptr;
+			std::rethrow_exception(e);
+		}
+	}
+
+	void ThreadPool::parallel_for(size_t begin, size_t end, size_t chunk, const Task& _task)
+	{
+		launch(begin, end, chunk, _task);
+		wait();
+	}
+
+	void ThreadPool::worker_main(size_t index)
+	{
+		uint64_t seen = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				start_cv.wait(lock, [this, seen]() { return stopping || generation != seen; });
+
+				if (stopping) return;
+				seen = generation;
+			}
+
+			run_chunks(index);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--running == 0)
+				{
+					done_cv.notify_all();
+				}
+			}
+		}
+	}
+
+	void ThreadPool::run_chunks(size_t index)
+	{
+		try
+		{
+			// Drain our own queue first, then visit the other workers' queues in turn and steal from them.
+			// Chunks are claimed with fetch_add, so overshooting the end of a queue is harmless.
+			for (size_t k = 0; k < size(); k++)
+			{
+				ChunkQueue& queue = queues[(index + k) % size()];
+
+				while (true)
+				{
+					size_t chunk = queue.next.fetch_add(1, std::memory_order_relaxed);
+					if (chunk >= queue.end) break;
+
+					size_t begin = range_begin + chunk * chunk_size;
+					task(index, begin, std::min(begin + chunk_size, range_end));
+				}
+			}
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!error)
+			{
+				error = std::current_exception();
+			}
+		}
+	}
+}
+}
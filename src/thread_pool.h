@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sr
+{
+namespace util
+{
+	/**
+	 * A fixed-size pool of worker threads for data-parallel loops over index ranges.
+	 * A range is cut into chunks, and each worker is initially given a contiguous run of chunks.
+	 * A worker that runs out of chunks steals chunks from the runs of the other workers,
+	 * so that imbalances (e.g. from particles dying, or from expensive Kepler solves) even out.
+	 */
+	class ThreadPool
+	{
+	public:
+		/**
+		 * The function run on each chunk. `worker` is the index of the worker thread running the chunk,
+		 * in the range [0, `size()`), and can be used to select per-thread scratch data.
+		 */
+		using Task = std::function<void(size_t worker, size_t begin, size_t end)>;
+
+		/** Ctor with the number of worker threads. If zero, the hardware concurrency is used. */
+		ThreadPool(size_t num_threads);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		/** Gets the number of worker threads. */
+		inline size_t size() const { return threads.size(); }
+
+		/**
+		 * Starts running `task` over [`begin`, `end`) in chunks of at most `chunk` indices
+		 * and returns immediately. `wait()` must be called before the next `launch()`.
+		 */
+		void launch(size_t begin, size_t end, size_t chunk, const Task& task);
+
+		/**
+		 * Blocks until all of the chunks of the last `launch()` have finished.
+		 * If any chunk threw an exception, the first exception is rethrown here.
+		 */
+		void wait();
+
+		/** Equivalent to `launch()` followed by `wait()`. */
+		void parallel_for(size_t begin, size_t end, size_t chunk, const Task& task);
+
+	private:
+		/** A run of chunks owned by one worker. Padded to avoid false sharing. */
+		struct ChunkQueue
+		{
+			std::atomic<size_t> next;
+			size_t end;
+			char padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+		};
+
+		void worker_main(size_t index);
+		void run_chunks(size_t index);
+
+		std::vector<std::thread> threads;
+		std::unique_ptr<ChunkQueue[]> queues;
+
+		std::mutex mutex;
+		std::condition_variable start_cv, done_cv;
+
+		uint64_t generation;
+		size_t running;
+		bool stopping;
+
+		Task task;
+		size_t range_begin, range_end, chunk_size;
+		std::exception_ptr error;
+	};
+}
+}
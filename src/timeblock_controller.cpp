@@ -0,0 +1,60 @@
+#include "timeblock_controller.h"
+
+#include <algorithm>
+
+namespace sr
+{
+namespace exec
+{
+	const uint32_t TimeblockController::WINDOW;
+
+	TimeblockController::TimeblockController() : target(1), min_steps(1), max_steps(1), growing(false),
+		window_blocks(0), window_steps(0), window_millis(0), last_cost(-1) { }
+
+	void TimeblockController::reset(uint32_t _min_steps, uint32_t _max_steps)
+	{
+		min_steps = std::max<uint32_t>(_min_steps, 1);
+		max_steps = std::max(_max_steps, min_steps);
+		target.store(max_steps, std::memory_order_relaxed);
+
+		growing = false;
+		window_blocks = 0;
+		window_steps = 0;
+		window_millis = 0;
+		last_cost = -1;
+	}
+
+	void TimeblockController::record(uint32_t steps, double millis)
+	{
+		uint32_t current = target.load(std::memory_order_relaxed);
+		if (steps != current) return;
+
+		window_blocks++;
+		window_steps += steps;
+		window_millis += millis;
+
+		if (window_blocks < WINDOW) return;
+
+		double cost = window_millis / static_cast<double>(window_steps);
+		if (last_cost >= 0 && cost > last_cost)
+		{
+			growing = !growing;
+		}
+
+		last_cost = cost;
+		window_blocks = 0;
+		window_steps = 0;
+		window_millis = 0;
+
+		// Turn around at the bounds, so that the neighbouring length keeps being probed
+		uint32_t next = growing ? std::min(max_steps, current * 2) : std::max(min_steps, current / 2);
+		if (next == current)
+		{
+			growing = !growing;
+			next = growing ? std::min(max_steps, current * 2) : std::max(min_steps, current / 2);
+		}
+
+		target.store(next, std::memory_order_relaxed);
+	}
+}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace sr
+{
+namespace exec
+{
+	/**
+	 * Picks the length of the CPU timeblocks online, for `Adaptive-Time-Block`. The best length depends on the particle count,
+	 * which falls by orders of magnitude during a run, so it is found by hill climbing on the measured time per step:
+	 * after a window of timeblocks at the current length, the length is doubled or halved within the bounds,
+	 * and the direction is reversed whenever the time per step got worse.
+	 */
+	class TimeblockController
+	{
+	public:
+		/** The number of timeblocks of the target length that make up one measurement. */
+		static const uint32_t WINDOW = 8;
+
+		TimeblockController();
+
+		TimeblockController(const TimeblockController&) = delete;
+		TimeblockController& operator=(const TimeblockController&) = delete;
+
+		/** Starts over from `max_steps`, the longest timeblock. */
+		void reset(uint32_t min_steps, uint32_t max_steps);
+
+		/** Gets the length to give the next timeblock. Can be called from any thread. */
+		inline uint32_t steps() const { return target.load(std::memory_order_relaxed); }
+
+		/**
+		 * Records that a timeblock of `steps` steps took `millis`. Timeblocks of any other length than the target,
+		 * e.g. ones that were planned before the target changed, are not counted.
+		 */
+		void record(uint32_t steps, double millis);
+
+	private:
+		std::atomic<uint32_t> target;
+		uint32_t min_steps, max_steps;
+		bool growing;
+
+		uint32_t window_blocks;
+		uint64_t window_steps;
+		double window_millis;
+
+		/** The time per step of the last window, or negative before the first one. */
+		double last_cost;
+	};
+}
+}
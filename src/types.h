@@ -1,7 +1,10 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include <cstdlib>
+#include <new>
 #include <ostream>
+#include "allocation_counter.h"
 
 #define M_PI 3.14159265358979323846
 #define M_2PI M_PI * 2
@@ -159,3 +162,170 @@ inline std::ostream& operator<<(std::ostream& stream, const v_3<T>& v)
 
 using f64_3 = v_3<float64_t>;
 using Vf64_3 = std::vector<f64_3>;
+
+/**
+ * An allocator that aligns its allocations to `Align` bytes, so that
+ * vector loads from the start of an array never straddle a cache line.
+ */
+template<typename T, size_t Align = 64>
+struct aligned_allocator
+{
+	using value_type = T;
+
+	template<typename U>
+	struct rebind { using other = aligned_allocator<U, Align>; };
+
+	inline aligned_allocator() = default;
+	template<typename U>
+	inline aligned_allocator(const aligned_allocator<U, Align>&) { }
+
+	inline T* allocate(size_t n)
+	{
+		sr::util::count_allocation(n * sizeof(T));
+
+		void* ptr;
+		if (posix_memalign(&ptr, Align, n * sizeof(T)) != 0)
+		{
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(ptr);
+	}
+
+	inline void deallocate(T* ptr, size_t)
+	{
+		free(ptr);
+	}
+};
+
+template<typename T, typename U, size_t Align>
+inline bool operator==(const aligned_allocator<T, Align>&, const aligned_allocator<U, Align>&) { return true; }
+template<typename T, typename U, size_t Align>
+inline bool operator!=(const aligned_allocator<T, Align>&, const aligned_allocator<U, Align>&) { return false; }
+
+template<typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+/**
+ * A reference to a 3-vector that is stored across the three columns of a `soa_3`.
+ * It can be used in most places that a `v_3` can: converting it to a `v_3`
+ * reads the components, and assigning to it writes the components.
+ */
+template<typename T>
+struct v_3_ref
+{
+	T& x;
+	T& y;
+	T& z;
+
+	inline v_3_ref(T& _x, T& _y, T& _z) : x(_x), y(_y), z(_z) { }
+	inline v_3_ref(const v_3_ref<T>& other) = default;
+
+	inline operator v_3<T>() const
+	{
+		return v_3<T>(x, y, z);
+	}
+
+	inline const v_3_ref<T>& operator=(const v_3<T>& a)
+	{
+		x = a.x;
+		y = a.y;
+		z = a.z;
+		return *this;
+	}
+
+	inline const v_3_ref<T>& operator=(const v_3_ref<T>& a)
+	{
+		x = a.x;
+		y = a.y;
+		z = a.z;
+		return *this;
+	}
+
+	inline const v_3_ref<T>& operator+=(const v_3<T>& a)
+	{
+		x += a.x;
+		y += a.y;
+		z += a.z;
+		return *this;
+	}
+
+	inline const v_3_ref<T>& operator-=(const v_3<T>& a)
+	{
+		x -= a.x;
+		y -= a.y;
+		z -= a.z;
+		return *this;
+	}
+
+	inline const v_3_ref<T>& operator*=(T a)
+	{
+		x *= a;
+		y *= a;
+		z *= a;
+		return *this;
+	}
+
+	inline T lensq() const
+	{
+		return x * x + y * y + z * z;
+	}
+
+	inline v_3<T> operator+(const v_3<T>& b) const
+	{
+		return v_3<T>(x + b.x, y + b.y, z + b.z);
+	}
+
+	inline v_3<T> operator-(const v_3<T>& b) const
+	{
+		return v_3<T>(x - b.x, y - b.y, z - b.z);
+	}
+
+	inline v_3<T> operator*(T b) const
+	{
+		return v_3<T>(x * b, y * b, z * b);
+	}
+};
+
+template<typename T>
+inline std::ostream& operator<<(std::ostream& stream, const v_3_ref<T>& v)
+{
+	return stream << v.x << " " << v.y << " " << v.z;
+}
+
+/**
+ * An array of 3-vectors in structure-of-arrays layout: the x, y and z components
+ * are stored in separate 64-byte aligned columns, so that loops over the
+ * components of consecutive vectors can use the full SIMD width.
+ * Indexing a mutable array gives a `v_3_ref`, and indexing a const array gives a `v_3`,
+ * so element-wise code can be written the same way as for `std::vector<v_3<T>>`.
+ * Hot loops should work on the columns directly.
+ */
+template<typename T>
+struct soa_3
+{
+	aligned_vector<T> x, y, z;
+
+	inline soa_3() = default;
+	explicit inline soa_3(size_t n) : x(n), y(n), z(n) { }
+
+	inline size_t size() const { return x.size(); }
+
+	inline void resize(size_t n)
+	{
+		x.resize(n);
+		y.resize(n);
+		z.resize(n);
+	}
+
+	inline v_3_ref<T> operator[](size_t i)
+	{
+		return v_3_ref<T>(x[i], y[i], z[i]);
+	}
+
+	inline v_3<T> operator[](size_t i) const
+	{
+		return v_3<T>(x[i], y[i], z[i]);
+	}
+};
+
+using SoAf64_3 = soa_3<float64_t>;
@@ -1,7 +1,9 @@
 #include "util.h"
 
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 namespace sr
@@ -53,5 +55,45 @@ namespace util
 	{
 		mkdir(path.c_str(), ACCESSPERMS);
 	}
+
+	MappedFile::MappedFile(const std::string& path) : _data(nullptr), _size(0)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			throw std::runtime_error("Could not open " + path);
+		}
+
+		struct stat s;
+		if (fstat(fd, &s) != 0)
+		{
+			close(fd);
+			throw std::runtime_error("Could not get the size of " + path);
+		}
+
+		_size = static_cast<size_t>(s.st_size);
+
+		// An empty file cannot be mapped
+		if (_size > 0)
+		{
+			void* map = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map == MAP_FAILED)
+			{
+				close(fd);
+				throw std::runtime_error("Could not map " + path);
+			}
+
+			// The whole file is about to be read, so have the kernel start reading it in
+			madvise(map, _size, MADV_WILLNEED);
+			_data = static_cast<const char*>(map);
+		}
+
+		close(fd);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (_data) munmap(const_cast<char*>(_data), _size);
+	}
 }
 }
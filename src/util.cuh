@@ -34,3 +34,62 @@ inline cudaError_t memcpy_htd(thrust::device_vector<T>& dest, const std::vector<
 	return cudaMemcpyAsync(dest.data().get() + destbegin, src.data() + srcbegin, len * sizeof(T), cudaMemcpyHostToDevice, stream);
 }
 
+
+/**
+ * Copies 3-vectors from the device into the columns of a `soa_3`. The device stores 3-vectors interleaved,
+ * so the data is staged through a host buffer and this call synchronizes `stream`.
+ */
+template<typename T>
+inline cudaError_t memcpy_dth(soa_3<T>& dest, const thrust::device_vector<v_3<T>>& src, cudaStream_t stream, size_t destbegin = 0, size_t srcbegin = 0, size_t len = static_cast<uint32_t>(-1))
+{
+	if (len == static_cast<uint32_t>(-1))
+	{
+		len = src.size();
+	}
+	if (dest.size() < destbegin + len)
+	{
+		throw std::exception();
+	}
+
+	std::vector<v_3<T>> staging(len);
+	cudaError_t err = memcpy_dth(staging, src, stream, 0, srcbegin, len);
+	if (err != cudaSuccess) return err;
+
+	err = cudaStreamSynchronize(stream);
+	if (err != cudaSuccess) return err;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		dest[destbegin + i] = staging[i];
+	}
+
+	return cudaSuccess;
+}
+
+/**
+ * Copies 3-vectors from the columns of a `soa_3` to the device. The device stores 3-vectors interleaved,
+ * so the data is staged through a host buffer and this call synchronizes `stream`.
+ */
+template<typename T>
+inline cudaError_t memcpy_htd(thrust::device_vector<v_3<T>>& dest, const soa_3<T>& src, cudaStream_t stream, size_t destbegin = 0, size_t srcbegin = 0, size_t len = static_cast<uint32_t>(-1))
+{
+	if (len == static_cast<uint32_t>(-1))
+	{
+		len = src.size();
+	}
+	if (dest.size() < destbegin + len)
+	{
+		throw std::exception();
+	}
+
+	std::vector<v_3<T>> staging(len);
+	for (size_t i = 0; i < len; i++)
+	{
+		staging[i] = src[srcbegin + i];
+	}
+
+	cudaError_t err = memcpy_htd(dest, staging, stream, destbegin, 0, len);
+	if (err != cudaSuccess) return err;
+
+	return cudaStreamSynchronize(stream);
+}
@@ -3,6 +3,9 @@
 #include <algorithm>
 #include <ostream>
 #include <memory>
+#include <limits>
+#include <string>
+#include <stdexcept>
 
 #if __cplusplus < 201404L
 namespace std
@@ -45,6 +48,25 @@ namespace util
 	bool is_dir_empty(const std::string& dirname);
 	void make_dir(const std::string& path);
 
+	/** A read-only memory mapping of a whole file. Throws if the file cannot be opened or mapped. */
+	class MappedFile
+	{
+	public:
+		MappedFile(const std::string& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		/** Gets the contents of the file, or null if it is empty. */
+		inline const char* data() const { return _data; }
+		inline size_t size() const { return _size; }
+
+	private:
+		const char* _data;
+		size_t _size;
+	};
+
 	class teebuf : public std::streambuf
 	{
 		public:
@@ -1,4 +1,5 @@
 #include "wh.h"
+#include "kernels.h"
 #include "convert.h"
 
 #include <iomanip>
@@ -6,16 +7,165 @@
 #include <sstream>
 #include <stdexcept>
 #include <iostream>
+#include <algorithm>
 
 namespace sr
 {
 namespace wh
 {
 	const uint32_t MAXKEP = 10;
-	const float64_t TOLKEP = 1E-14;
 
 	using namespace sr::data;
 
+	namespace
+	{
+		// The coefficients of the symplectic correctors of Wisdom, Holman & Touma (1996), as used by WHFast (Rein & Tamayo 2015).
+		// The drift times are multiples of sqrt(7 / 40) timesteps.
+		const float64_t CORRECTOR_A_1 = 0.41833001326703777398908601289259374469640768464934;
+		const float64_t CORRECTOR_A_2 = 0.83666002653407554797817202578518748939281536929867;
+		const float64_t CORRECTOR_A_3 = 1.2549900398011133219672580386777812340892230539480;
+		const float64_t CORRECTOR_B_31 = -0.024900596027799867499350357910273437184309981229121;
+		const float64_t CORRECTOR_B_51 = -0.0083001986759332891664501193034244790614366604097070;
+		const float64_t CORRECTOR_B_52 = 0.041500993379666445832250596517122395307183302048535;
+		const float64_t CORRECTOR_B_71 = 0.0024926811426922105779030593952776964450539008582219;
+		const float64_t CORRECTOR_B_72 = -0.018270923246702402789205470549005343742117590066890;
+		const float64_t CORRECTOR_B_73 = 0.053206429628799061432328036010829045787428693289706;
+
+		/** Adds the acceleration from planet `j` to `a`, and flags a close encounter with it. */
+		inline void accelerate_planet(HostParticlePhaseSpace& pa, size_t particle_index, f64_3& a, uint32_t j,
+				const f64_3* r_log_step, const float64_t* m, const float64_t* rh2)
+		{
+			f64_3 dr = pa.r()[particle_index] - r_log_step[j - 1];
+#ifdef USE_FMA
+			float64_t planet_rji2 = std::fma(dr.x, dr.x, std::fma(dr.y, dr.y, dr.z * dr.z));
+#else
+			float64_t planet_rji2 = dr.lensq();
+#endif
+
+			float64_t irij3 = 1. / (planet_rji2 * std::sqrt(planet_rji2));
+			float64_t fac = m[j] * irij3;
+
+#ifdef USE_FMA
+			a.x = std::fma(-dr.x, fac, a.x);
+			a.y = std::fma(-dr.y, fac, a.y);
+			a.z = std::fma(-dr.z, fac, a.z);
+#else
+			a -= dr * fac;
+#endif
+
+			if (planet_rji2 < rh2[j])
+			{
+				pa.deathflags()[particle_index] = pa.deathflags()[particle_index] & 0x00FF;
+				pa.deathflags()[particle_index] = static_cast<uint16_t>(pa.deathflags()[particle_index] | (j << 8) | 0x0001);
+			}
+		}
+
+		/** Steps the planets through a timeblock with the planet count specialization picked by `dispatch_planet_count`. */
+		struct PlanetTimeblock
+		{
+			WHIntegrator& integrator;
+			HostPlanetPhaseSpace& pl;
+			float64_t t;
+
+			template<uint32_t N>
+			void run()
+			{
+				for (size_t i = 0; i < integrator.tbsize; i++)
+				{
+					integrator.step_planets<N>(pl, t, i);
+					t += integrator.dt;
+				}
+			}
+		};
+
+		/** Steps particles through a timeblock with the planet count specialization picked by `dispatch_planet_count`. */
+		struct ParticleTimeblock
+		{
+			WHIntegrator& integrator;
+			const HostPlanetPhaseSpace& pl;
+			HostParticlePhaseSpace& pa;
+			size_t begin, length;
+			float64_t t;
+
+			template<uint32_t N>
+			void run()
+			{
+				for (size_t i = 0; i < integrator.tbsize; i++)
+				{
+					integrator.step_particles<N>(pl, pa, begin, length, t, i);
+					t += integrator.dt;
+				}
+			}
+		};
+
+		/**
+		 * Computes the accelerations `planet_a` of the first `n` planets and the heliocentric acceleration `h0` from their positions and
+		 * their Jacobi positions `planet_rj`, see `WHIntegrator::helio_acc_planets`. The corrector calls this with its own scratch arrays.
+		 */
+		void planet_accelerations(const HostPlanetPhaseSpace& p, size_t n, const Vf64& planet_eta, const Vf64_3& planet_rj,
+				Vf64& planet_inverse_helio_cubed, Vf64& planet_inverse_jacobi_cubed, Vf64_3& planet_a, f64_3& h0)
+		{
+			for (size_t i = 1; i < n; i++)
+			{
+				float64_t r2 = p.r()[i].lensq();
+				planet_inverse_helio_cubed[i] =
+					1. / (std::sqrt(r2) * r2);
+				r2 = planet_rj[i].lensq();
+				planet_inverse_jacobi_cubed[i] =
+					1. / (std::sqrt(r2) * r2);
+			}
+
+			// compute common heliocentric acceleration
+			f64_3 a_common(0);
+			for (size_t i = 2; i < n; i++)    
+			{
+				float64_t mfac = p.m()[i] * planet_inverse_helio_cubed[i];
+				a_common -= p.r()[i] * mfac;
+			}
+
+			// Load this into all the arrays
+			for (size_t i = 1; i < n; i++)    
+			{
+				planet_a[i] = a_common;
+			}
+
+			h0 = a_common - p.r()[1] * p.m()[1] * planet_inverse_helio_cubed[1];
+
+			// Now do indirect acceleration ; note that planet 1 does not receive a contribution 
+			for (size_t i = 2; i < n; i++)    
+			{
+				planet_a[i] += (planet_rj[i] * planet_inverse_jacobi_cubed[i] - p.r()[i] * planet_inverse_helio_cubed[i]) * p.m()[0];
+			}
+
+			/* next term ; again, first planet does not participate */
+			f64_3 a_accum(0);
+			for (size_t i = 2; i < n; i++)    
+			{
+				float64_t mfac = p.m()[i] * p.m()[0] * planet_inverse_jacobi_cubed[i] / planet_eta[i-1];
+				a_accum += planet_rj[i] * mfac;
+				planet_a[i] += a_accum;
+			}
+
+			/* Finally, incorporate the direct accelerations */
+			for (size_t i = 1; i < n - 1; i++)    
+			{
+				for (size_t j = i + 1; j < n; j++)    
+				{
+					f64_3 dr = p.r()[j] - p.r()[i];
+					float64_t r2 = dr.lensq();
+					float64_t irij3 = 1. / (r2 * std::sqrt(r2));
+
+					float64_t mfac = p.m()[i] * irij3;
+					planet_a[j] -= dr * mfac;
+
+					// acc. on i is just negative, with m[j] instead
+					mfac = p.m()[j] * irij3;
+					planet_a[i] += dr * mfac;
+				}
+			}
+		}
+	}
+
 	void print_tiss(const HostPlanetPhaseSpace& pl, const HostParticlePhaseSpace& pa)
 	{
 		double aout, eout, iout, aj;
@@ -54,6 +204,33 @@ namespace wh
 		return true;
 	}
 
+	bool kepeq_fixed(double dM, double ecosEo, double esinEo, double* dE, double* sindE, double* cosdE, uint32_t iterations)
+	{
+		*sindE = std::sin(*dE);
+		*cosdE = std::cos(*dE);
+
+		// Danby's fourth-order correction: the higher derivatives only need the sine and cosine we already have
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			double f = *dE - ecosEo * (*sindE) + esinEo * (1. - *cosdE) - dM;
+			double fp = 1. - ecosEo * (*cosdE) + esinEo * (*sindE);
+			double fpp = ecosEo * (*sindE) + esinEo * (*cosdE);
+			double fppp = ecosEo * (*cosdE) - esinEo * (*sindE);
+
+			double delta = -f / fp;
+			delta = -f / (fp + 0.5 * delta * fpp);
+			delta = -f / (fp + 0.5 * delta * fpp + delta * delta * fppp / 6.);
+
+			*dE += delta;
+			*sindE = std::sin(*dE);
+			*cosdE = std::cos(*dE);
+		}
+
+		double f = *dE - ecosEo * (*sindE) + esinEo * (1. - *cosdE) - dM;
+		double fp = 1. - ecosEo * (*cosdE) + esinEo * (*sindE);
+
+		return !(std::fabs(f / fp) < TOLKEP);
+	}
 
 	void calculate_planet_metrics(const HostPlanetPhaseSpace& pl, double* energy, f64_3* l)
 	{
@@ -126,6 +303,10 @@ namespace wh
 
 		tbsize = config.tbsize;
 		dt = config.dt;
+		maxkep = config.max_kep;
+		fixed_kepler = config.cpu_fixed_kepler;
+		corrector_order = config.corrector_order;
+		mixed_ratio2 = config.mixed_precision_ratio * config.mixed_precision_ratio;
 
 		planet_h0_log = sr::util::LogQuartet<Vf64_3>(tbsize);
 
@@ -142,11 +323,19 @@ namespace wh
 			// to be a multiple of the planet's respective hill sphere.
 		}
 
+		planet_rh2 = Vf64(pl.n());
+		for (size_t i = 0; i < pl.n(); i++)
+		{
+			planet_rh2[i] = planet_rh[i] * planet_rh[i];
+		}
+
+		to_mapping_coordinates(pl, &pa);
+
 		sr::convert::helio_to_jacobi_r_planets(pl, planet_eta, planet_rj);
 		sr::convert::helio_to_jacobi_v_planets(pl, planet_eta, planet_vj);
 
 		std::copy(pl.r().begin() + 1, pl.r().end(), pl.r_log().old.begin());
-		helio_acc_planets(pl, 0);
+		helio_acc_planets(pl, planet_h0_log.get<true>()[0]);
 		helio_acc_particles<true>(pl, pa, 0, pa.n_alive(), 0, 0);
 	}
 
@@ -157,11 +346,8 @@ namespace wh
 
 	void WHIntegrator::integrate_planets_timeblock(HostPlanetPhaseSpace& pl, float64_t t)
 	{
-		for (size_t i = 0; i < tbsize; i++)
-		{
-			step_planets(pl, t, i);
-			t += dt;
-		}
+		PlanetTimeblock timeblock = { *this, pl, t };
+		dispatch_planet_count(static_cast<uint32_t>(pl.n_alive()), timeblock);
 	}
 
 	void WHIntegrator::integrate_particles_timeblock(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length, float64_t t)
@@ -176,130 +362,190 @@ namespace wh
 			this->particle_mu[i] = pl.m()[0];
 		}
 
-		for (size_t i = 0; i < tbsize; i++)
-		{
-			step_particles(pl, pa, begin, length, t, i);
-			t += dt;
-		}
+		ParticleTimeblock timeblock = { *this, pl, pa, begin, length, t };
+		dispatch_planet_count(static_cast<uint32_t>(pl.n_alive()), timeblock);
 	}
 
-	template<bool old>
-	void WHIntegrator::helio_acc_particle(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t particle_index, float64_t time, size_t timestep_index)
+	template<uint32_t N>
+	void WHIntegrator::helio_acc_particle(HostParticlePhaseSpace& pa, size_t particle_index, float64_t time, uint32_t planet_n,
+			const f64_3& h0, const f64_3* r_log_step, const float64_t* m, const float64_t* rh2)
 	{
 		f64_3& a = particle_a[particle_index];
-		a = planet_h0_log.get<old>()[timestep_index];
+		a = h0;
 
-		for (size_t j = 1; j < pl.n_alive(); j++)
+		// The unroll pragma needs a trip count known at compile time, so only the specialized loop has it
+		if (N != 0)
 		{
-			f64_3 dr = pa.r()[particle_index] - pl.r_log().get<old>()[pl.log_index_at<old>(timestep_index, j)];
-#ifdef USE_FMA
-			float64_t planet_rji2 = std::fma(dr.x, dr.x, std::fma(dr.y, dr.y, dr.z * dr.z));
-#else
-			float64_t planet_rji2 = dr.lensq();
-#endif
-
-			float64_t irij3 = 1. / (planet_rji2 * std::sqrt(planet_rji2));
-			float64_t fac = pl.m()[j] * irij3;
-
-#ifdef USE_FMA
-			a.x = std::fma(-dr.x, fac, a.x);
-			a.y = std::fma(-dr.y, fac, a.y);
-			a.z = std::fma(-dr.z, fac, a.z);
-#else
-			a -= dr * fac;
-#endif
-
-			if (planet_rji2 < planet_rh[j] * planet_rh[j])
+			UNROLL_PLANETS
+			for (uint32_t j = 1; j < N + 1; j++)
 			{
-					pa.deathflags()[particle_index] = pa.deathflags()[particle_index] & 0x00FF;
-					pa.deathflags()[particle_index] = static_cast<uint16_t>(pa.deathflags()[particle_index] | (j << 8) | 0x0001);
+				accelerate_planet(pa, particle_index, a, j, r_log_step, m, rh2);
+			}
+		}
+		else
+		{
+			for (uint32_t j = 1; j < planet_n; j++)
+			{
+				accelerate_planet(pa, particle_index, a, j, r_log_step, m, rh2);
 			}
 		}
 
 		float64_t planet_rji2 = pa.r()[particle_index].lensq();
 
-		if (planet_rji2 < planet_rh[0] * planet_rh[0])
+		if (planet_rji2 < rh2[0])
 		{
 			pa.deathflags()[particle_index] = pa.deathflags()[particle_index] & 0x00FF;
 			pa.deathflags()[particle_index] = pa.deathflags()[particle_index] | 0x0001;
 		}
 
-		if (planet_rji2 > 2000 * 2000)
+		if (planet_rji2 > OUT_OF_BOUNDS_RADIUS * OUT_OF_BOUNDS_RADIUS)
 		{
 			pa.deathtime()[particle_index] = static_cast<float>(time);
 			pa.deathflags()[particle_index] = pa.deathflags()[particle_index] | 0x0002;
 		}
 	}
 
-	template<bool old>
+	template<bool old, uint32_t N>
 	void WHIntegrator::helio_acc_particles(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length, float64_t time, size_t timestep_index)
 	{
+		const uint32_t planet_n = static_cast<uint32_t>(pl.n_alive());
+		const f64_3& h0 = planet_h0_log.get<old>()[timestep_index];
+		const f64_3* r_log_step = pl.r_log().get<old>().data() + pl.log_index_at<old>(timestep_index, 1);
+		MVSKernelBase::PlanetConstants<N> planets(pl.m().data(), planet_rh2.data());
+
 		for (size_t i = begin; i < begin + length; i++)
 		{
-			helio_acc_particle<old>(pl, pa, i, time, timestep_index);
+			helio_acc_particle<N>(pa, i, time, planet_n, h0, r_log_step, planets.m, planets.rh2);
 		}
 	}
 
-	void WHIntegrator::helio_acc_planets(HostPlanetPhaseSpace& p, size_t index)
+	template<uint32_t N>
+	void WHIntegrator::helio_acc_planets(HostPlanetPhaseSpace& p, f64_3& h0)
 	{
-		for (size_t i = 1; i < p.n_alive(); i++)
-		{
-			float64_t r2 = p.r()[i].lensq();
-			this->planet_inverse_helio_cubed[i] =
-				1. / (std::sqrt(r2) * r2);
-			r2 = this->planet_rj[i].lensq();
-			this->planet_inverse_jacobi_cubed[i] =
-				1. / (std::sqrt(r2) * r2);
-		}
-		
-		// compute common heliocentric acceleration
-		f64_3 a_common(0);
-		for (size_t i = 2; i < p.n_alive(); i++)    
-		{
-			float64_t mfac = p.m()[i] * this->planet_inverse_helio_cubed[i];
-			a_common -= p.r()[i] * mfac;
-		}
+		planet_accelerations(p, planet_count<N>(static_cast<uint32_t>(p.n_alive())), planet_eta, planet_rj,
+				planet_inverse_helio_cubed, planet_inverse_jacobi_cubed, planet_a, h0);
+	}
 
-		// Load this into all the arrays
-		for (size_t i = 1; i < p.n_alive(); i++)    
-		{
-			planet_a[i] = a_common;
-		}
+	CorrectorScratch::CorrectorScratch(size_t n)
+	{
+		inverse_helio_cubed = inverse_jacobi_cubed = Vf64(n);
+		dist = energy = vdotr = mu = Vf64(n);
+		mask = Vu8(n);
+		rj = vj = a = Vf64_3(n);
+	}
+
+	void WHIntegrator::to_real_coordinates(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa) const
+	{
+		if (!corrector_order) return;
+
+		// The leapfrog here is kick-drift-kick, while the corrector is for drift-kick-drift. The two are conjugate:
+		// KDK^n = Q DKD^n Q^-1 with Q a half kick followed by a half drift, so Q is applied before the corrector.
+		CorrectorScratch scratch(pl.n());
+		corrector_interaction_step(scratch, pl, pa, dt / 2);
+		corrector_kepler_step(scratch, pl, pa, dt / 2);
+		apply_corrector(scratch, pl, pa, -1);
+	}
+
+	void WHIntegrator::to_mapping_coordinates(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa)
+	{
+		if (!corrector_order) return;
+
+		CorrectorScratch scratch(pl.n());
+		apply_corrector(scratch, pl, pa, 1);
+		corrector_kepler_step(scratch, pl, pa, -dt / 2);
+		corrector_interaction_step(scratch, pl, pa, -dt / 2);
+	}
 
-		planet_h0_log.get<true>()[index] = a_common - p.r()[1] * p.m()[1] * this->planet_inverse_helio_cubed[1];
-		
-		// Now do indirect acceleration ; note that planet 1 does not receive a contribution 
-		for (size_t i = 2; i < p.n_alive(); i++)    
+	void WHIntegrator::corrector_kepler_step(CorrectorScratch& scratch, HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa, float64_t t) const
+	{
+		sr::convert::helio_to_jacobi_r_planets(pl, planet_eta, scratch.rj);
+		sr::convert::helio_to_jacobi_v_planets(pl, planet_eta, scratch.vj);
+
+		for (size_t i = 1; i < pl.n_alive(); i++)
 		{
-			planet_a[i] += (this->planet_rj[i] * this->planet_inverse_jacobi_cubed[i] - p.r()[i] * this->planet_inverse_helio_cubed[i]) * p.m()[0];
+			scratch.mu[i] = pl.m()[0] * this->planet_eta[i] / this->planet_eta[i - 1];
+			scratch.mask[i] = 0;
 		}
-		
-		/* next term ; again, first planet does not participate */
-		f64_3 a_accum(0);
-		for (size_t i = 2; i < p.n_alive(); i++)    
+
+		drift(t, scratch.rj, scratch.vj, 1, pl.n_alive() - 1, scratch.dist, scratch.energy, scratch.vdotr, scratch.mu, scratch.mask);
+		sr::convert::jacobi_to_helio_planets(planet_eta, scratch.rj, scratch.vj, pl);
+
+		if (!pa) return;
+
+		for (size_t i = 0; i < pa->n_alive(); i++)
 		{
-			float64_t mfac = p.m()[i] * p.m()[0] * this->planet_inverse_jacobi_cubed[i] / this->planet_eta[i-1];
-			a_accum += this->planet_rj[i] * mfac;
-			planet_a[i] += a_accum;
+			if (pa->deathflags()[i]) continue;
+
+			f64_3 r = pa->r()[i], v = pa->v()[i];
+			uint16_t flags = 0;
+			MVSKernelBase::drift(r, v, flags, t, pl.m()[0], maxkep);
+
+			pa->r()[i] = r;
+			pa->v()[i] = v;
 		}
+	}
+
+	void WHIntegrator::corrector_interaction_step(CorrectorScratch& scratch, HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa, float64_t t) const
+	{
+		f64_3 h0;
+		sr::convert::helio_to_jacobi_r_planets(pl, planet_eta, scratch.rj);
+		planet_accelerations(pl, pl.n_alive(), planet_eta, scratch.rj, scratch.inverse_helio_cubed, scratch.inverse_jacobi_cubed, scratch.a, h0);
 
-		/* Finally, incorporate the direct accelerations */
-		for (size_t i = 1; i < p.n_alive() - 1; i++)    
+		if (pa)
 		{
-			for (size_t j = i + 1; j < p.n_alive(); j++)    
+			for (size_t i = 0; i < pa->n_alive(); i++)
 			{
-				f64_3 dr = p.r()[j] - p.r()[i];
-				float64_t r2 = dr.lensq();
-				float64_t irij3 = 1. / (r2 * std::sqrt(r2));
+				if (pa->deathflags()[i]) continue;
 
-				float64_t mfac = p.m()[i] * irij3;
-				planet_a[j] -= dr * mfac;
+				f64_3 a;
+				uint16_t flags = 0;
+				MVSKernelBase::accelerate<0>(pa->r()[i], a, flags, static_cast<uint32_t>(pl.n_alive()), h0, pl.r().data() + 1, pl.m().data(), planet_rh2.data());
 
-				// acc. on i is just negative, with m[j] instead
-				mfac = p.m()[j] * irij3;
-				planet_a[i] += dr * mfac;
+				pa->v()[i] += a * t;
 			}
 		}
+
+		for (size_t i = 1; i < pl.n_alive(); i++)
+		{
+			pl.v()[i] += scratch.a[i] * t;
+		}
+	}
+
+	void WHIntegrator::apply_corrector(CorrectorScratch& scratch, HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa, float64_t inverse) const
+	{
+		// Z(a, b) = K(a) I(-b) K(-2a) I(b) K(a), where K drifts and I kicks
+		auto z = [&](float64_t a, float64_t b)
+		{
+			corrector_kepler_step(scratch, pl, pa, a * dt);
+			corrector_interaction_step(scratch, pl, pa, -b * dt);
+			corrector_kepler_step(scratch, pl, pa, -2 * a * dt);
+			corrector_interaction_step(scratch, pl, pa, b * dt);
+			corrector_kepler_step(scratch, pl, pa, a * dt);
+		};
+
+		switch (corrector_order)
+		{
+			case 3:
+				z(CORRECTOR_A_1, -inverse * CORRECTOR_B_31);
+				z(-CORRECTOR_A_1, inverse * CORRECTOR_B_31);
+				break;
+			case 5:
+				z(-CORRECTOR_A_2, -inverse * CORRECTOR_B_51);
+				z(-CORRECTOR_A_1, -inverse * CORRECTOR_B_52);
+				z(CORRECTOR_A_1, inverse * CORRECTOR_B_52);
+				z(CORRECTOR_A_2, inverse * CORRECTOR_B_51);
+				break;
+			case 7:
+				z(-CORRECTOR_A_3, -inverse * CORRECTOR_B_71);
+				z(-CORRECTOR_A_2, -inverse * CORRECTOR_B_72);
+				z(-CORRECTOR_A_1, -inverse * CORRECTOR_B_73);
+				z(CORRECTOR_A_1, inverse * CORRECTOR_B_73);
+				z(CORRECTOR_A_2, inverse * CORRECTOR_B_72);
+				z(CORRECTOR_A_3, inverse * CORRECTOR_B_71);
+				break;
+			default:
+				throw std::invalid_argument("Unsupported symplectic corrector order");
+		}
 	}
 
 	bool WHIntegrator::drift_single(float64_t dt, float64_t mu, f64_3* r, f64_3* v)
@@ -354,7 +600,8 @@ namespace wh
 		return true;
 	}
 
-	void WHIntegrator::drift(float64_t t, Vf64_3& r, Vf64_3& v, size_t start, size_t n, Vf64& dist, Vf64& energy, Vf64& vdotr, Vf64& mu, Vu8& mask)
+	template<typename Vec3>
+	void WHIntegrator::drift(float64_t t, Vec3& r, Vec3& v, size_t start, size_t n, Vf64& dist, Vf64& energy, Vf64& vdotr, Vf64& mu, Vu8& mask, uint16_t* flags, uint32_t fixed_kep)
 	{
 		for (size_t i = start; i < start + n; i++)
 		{
@@ -411,9 +658,20 @@ namespace wh
 
 				bool error;
 				uint32_t its;
-				error = kepeq(dM, esinEo, ecosEo, &dE, &sindE, &cosdE, &its);
+				if (fixed_kep)
+				{
+					error = kepeq_fixed(dM, ecosEo, esinEo, &dE, &sindE, &cosdE, fixed_kep);
+				}
+				else
+				{
+					error = kepeq(dM, esinEo, ecosEo, &dE, &sindE, &cosdE, &its);
+				}
 
-				if (error)
+				if (error && flags)
+				{
+					flags[i] = static_cast<uint16_t>(flags[i] | 0x0008);
+				}
+				else if (error)
 				{
 					throw std::runtime_error("Unconverging kepler");
 				}
@@ -430,6 +688,7 @@ namespace wh
 		}
 	}
 
+	template<uint32_t N>
 	void WHIntegrator::step_particles(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length, float64_t t, size_t timestep_index)
 	{
 		for (size_t i = begin; i < begin + length; i++)
@@ -444,10 +703,11 @@ namespace wh
 
 		// Drift all the particles along their Jacobi Kepler ellipses
 		// Can change false to true to use fixed iterations
-		drift(dt, pa.r(), pa.v(), begin, length, particle_dist, particle_energy, particle_vdotr, particle_mu, particle_mask);
+		drift(dt, pa.r(), pa.v(), begin, length, particle_dist, particle_energy, particle_vdotr, particle_mu, particle_mask,
+				pa.deathflags().data(), fixed_kepler ? maxkep : 0);
 
 		// find the accelerations of the heliocentric velocities
-		helio_acc_particles<false>(pl, pa, begin, length, t, timestep_index);
+		helio_acc_particles<false, N>(pl, pa, begin, length, t, timestep_index);
 
 		for (size_t i = begin; i < begin + length; i++)
 		{
@@ -461,9 +721,199 @@ namespace wh
 
 	void WHIntegrator::gather_particles(const std::vector<size_t>& indices, size_t begin, size_t length)
 	{
-		gather(particle_a, indices, begin, length);
+		permute(indices, begin, length, particle_a);
+	}
+
+	static_assert(PARTICLE_TILE_SIZE % sr::kernels::LANES == 0, "a particle tile must be a whole number of drift batches");
+
+	void WHIntegrator::integrate_active_particles_timeblock(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length, float64_t t)
+	{
+		const uint32_t planet_n = static_cast<uint32_t>(pl.n_alive());
+		const f64_3* h0_log = planet_h0_log.get<false>().data();
+		const f64_3* r_log = pl.r_log().get<false>().data();
+		const uint32_t tb = static_cast<uint32_t>(tbsize);
+		const float64_t* m = pl.m().data();
+		const float64_t* rh2 = planet_rh2.data();
+		const float64_t mu = pl.m()[0];
+
+		const sr::kernels::KernelSet& kernels = sr::kernels::kernels();
+		const sr::kernels::KernelSet::Drift drift_kernel = fixed_kepler ? kernels.drift_fixed : kernels.drift;
+		const sr::kernels::KernelSet::Accelerate accelerate_kernel = kernels.accelerate[specialized_planets(planet_n)];
+		const sr::kernels::KernelSet::AccelerateMixed accelerate_mixed_kernel = kernels.accelerate_mixed[specialized_planets(planet_n)];
+
+		// The tile is kept as structure-of-arrays, so that the kernels can work on sr::kernels::LANES particles at once
+		alignas(64) float64_t rx[PARTICLE_TILE_SIZE], ry[PARTICLE_TILE_SIZE], rz[PARTICLE_TILE_SIZE];
+		alignas(64) float64_t vx[PARTICLE_TILE_SIZE], vy[PARTICLE_TILE_SIZE], vz[PARTICLE_TILE_SIZE];
+		alignas(64) float64_t ax[PARTICLE_TILE_SIZE], ay[PARTICLE_TILE_SIZE], az[PARTICLE_TILE_SIZE];
+		uint16_t flags[PARTICLE_TILE_SIZE];
+		uint32_t deathtime_index[PARTICLE_TILE_SIZE];
+		bool stepping[PARTICLE_TILE_SIZE];
+
+		for (size_t tile = begin; tile < begin + length; tile += PARTICLE_TILE_SIZE)
+		{
+			size_t n = std::min(PARTICLE_TILE_SIZE, begin + length - tile);
+			const uint32_t* indices = particle_active.data() + tile;
+
+			for (size_t k = 0; k < n; k++)
+			{
+				rx[k] = pa.r().x[indices[k]];
+				ry[k] = pa.r().y[indices[k]];
+				rz[k] = pa.r().z[indices[k]];
+				vx[k] = pa.v().x[indices[k]];
+				vy[k] = pa.v().y[indices[k]];
+				vz[k] = pa.v().z[indices[k]];
+				ax[k] = particle_a[indices[k]].x;
+				ay[k] = particle_a[indices[k]].y;
+				az[k] = particle_a[indices[k]].z;
+				flags[k] = pa.deathflags()[indices[k]];
+				deathtime_index[k] = 0;
+			}
+
+			// Pad the last batch of lanes with particles that never step
+			size_t n_lanes = (n + sr::kernels::LANES - 1) / sr::kernels::LANES * sr::kernels::LANES;
+			for (size_t k = n; k < n_lanes; k++)
+			{
+				rx[k] = ry[k] = rz[k] = 1;
+				vx[k] = vy[k] = vz[k] = 0;
+				ax[k] = ay[k] = az[k] = 0;
+				flags[k] = 0x0080;
+			}
+
+			// Step the whole tile in lockstep, with each phase of the step run across the tile: the tile stays in L1
+			// across the timeblock, and the independent particles give the CPU enough parallel work to hide the latency
+			// of the Kepler solver and the planet distances. This is the same sequence as MVSKernelBase::step_forward.
+			for (uint32_t step = 0; step < tb; step++)
+			{
+				for (size_t k = 0; k < n_lanes; k++)
+				{
+					stepping[k] = flags[k] == 0;
+					if (!stepping[k]) continue;
+
+					vx[k] += ax[k] * (dt / 2);
+					vy[k] += ay[k] * (dt / 2);
+					vz[k] += az[k] * (dt / 2);
+				}
+
+				drift_kernel(rx, ry, rz, vx, vy, vz, flags, stepping, n_lanes, dt, mu, maxkep);
+				if (mixed_ratio2 > 0)
+				{
+					accelerate_mixed_kernel(rx, ry, rz, ax, ay, az, flags, stepping, n_lanes, planet_n, h0_log[step], r_log + step * (planet_n - 1), m, rh2,
+							mixed_ratio2);
+				}
+				else
+				{
+					accelerate_kernel(rx, ry, rz, ax, ay, az, flags, stepping, n_lanes, planet_n, h0_log[step], r_log + step * (planet_n - 1), m, rh2);
+				}
+
+				for (size_t k = 0; k < n; k++)
+				{
+					if (!stepping[k]) continue;
+
+					vx[k] += ax[k] * (dt / 2);
+					vy[k] += ay[k] * (dt / 2);
+					vz[k] += az[k] * (dt / 2);
+					deathtime_index[k] = step + 1;
+				}
+			}
+
+			for (size_t k = 0; k < n; k++)
+			{
+				pa.r()[indices[k]] = f64_3(rx[k], ry[k], rz[k]);
+				pa.v()[indices[k]] = f64_3(vx[k], vy[k], vz[k]);
+				particle_a[indices[k]] = f64_3(ax[k], ay[k], az[k]);
+				pa.deathflags()[indices[k]] = flags[k];
+				pa.deathtime_index()[indices[k]] = deathtime_index[k];
+
+				if (flags[k])
+				{
+					pa.deathtime()[indices[k]] = static_cast<float>(t + dt * static_cast<double>(deathtime_index[k]));
+				}
+			}
+		}
+	}
+
+	float64_t WHIntegrator::mixed_precision_error(const HostPlanetPhaseSpace& pl, const HostParticlePhaseSpace& pa, size_t begin, size_t length) const
+	{
+		const uint32_t planet_n = static_cast<uint32_t>(pl.n_alive());
+		const f64_3* r_log_step = pl.r_log().get<false>().data() + (tbsize - 1) * (planet_n - 1);
+		const float64_t* m = pl.m().data();
+		const float64_t* rh2 = planet_rh2.data();
+
+		const sr::kernels::KernelSet& kernels = sr::kernels::kernels();
+		const sr::kernels::KernelSet::Accelerate accelerate_kernel = kernels.accelerate[specialized_planets(planet_n)];
+		const sr::kernels::KernelSet::AccelerateMixed accelerate_mixed_kernel = kernels.accelerate_mixed[specialized_planets(planet_n)];
+
+		// The common acceleration is the same in both, so it is left out
+		const f64_3 h0(0);
+
+		alignas(64) float64_t rx[PARTICLE_TILE_SIZE], ry[PARTICLE_TILE_SIZE], rz[PARTICLE_TILE_SIZE];
+		alignas(64) float64_t ax[PARTICLE_TILE_SIZE], ay[PARTICLE_TILE_SIZE], az[PARTICLE_TILE_SIZE];
+		alignas(64) float64_t mx[PARTICLE_TILE_SIZE], my[PARTICLE_TILE_SIZE], mz[PARTICLE_TILE_SIZE];
+		uint16_t flags[PARTICLE_TILE_SIZE];
+		bool active[PARTICLE_TILE_SIZE];
+
+		float64_t error = 0;
+
+		for (size_t tile = begin; tile < begin + length; tile += PARTICLE_TILE_SIZE)
+		{
+			size_t n = std::min(PARTICLE_TILE_SIZE, begin + length - tile);
+			size_t n_lanes = (n + sr::kernels::LANES - 1) / sr::kernels::LANES * sr::kernels::LANES;
+			const uint32_t* indices = particle_active.data() + tile;
+
+			for (size_t k = 0; k < n_lanes; k++)
+			{
+				rx[k] = k < n ? pa.r().x[indices[k]] : 1;
+				ry[k] = k < n ? pa.r().y[indices[k]] : 1;
+				rz[k] = k < n ? pa.r().z[indices[k]] : 1;
+				flags[k] = 0;
+				active[k] = true;
+			}
+
+			accelerate_kernel(rx, ry, rz, ax, ay, az, flags, active, n_lanes, planet_n, h0, r_log_step, m, rh2);
+			accelerate_mixed_kernel(rx, ry, rz, mx, my, mz, flags, active, n_lanes, planet_n, h0, r_log_step, m, rh2, mixed_ratio2);
+
+			for (size_t k = 0; k < n; k++)
+			{
+				f64_3 difference(mx[k] - ax[k], my[k] - ay[k], mz[k] - az[k]);
+				float64_t r2 = rx[k] * rx[k] + ry[k] * ry[k] + rz[k] * rz[k];
+
+				error = std::max(error, std::sqrt(difference.lensq()) * r2 / m[0]);
+			}
+		}
+
+		return error;
+	}
+
+	float64_t WHIntegrator::mixed_precision_bound(const HostPlanetPhaseSpace& pl) const
+	{
+		float64_t planet_mass = 0;
+		for (size_t i = 1; i < pl.n_alive(); i++)
+		{
+			planet_mass += pl.m()[i];
+		}
+
+		return 7.5 * std::ldexp(1., -24) * planet_mass / (pl.m()[0] * mixed_ratio2);
+	}
+
+	void WHIntegrator::reset_active_particles(const HostParticlePhaseSpace& pa)
+	{
+		particle_active.clear();
+
+		for (size_t i = 0; i < pa.n_alive(); i++)
+		{
+			if (pa.deathflags()[i] == 0)
+			{
+				particle_active.push_back(static_cast<uint32_t>(i));
+			}
+		}
+	}
+
+	void WHIntegrator::compact_active_particles(const HostParticlePhaseSpace& pa)
+	{
+		particle_active.resize(sr::kernels::kernels().compact(pa.deathflags().data(), particle_active.data(), particle_active.size()));
 	}
 
+	template<uint32_t N>
 	void WHIntegrator::step_planets(HostPlanetPhaseSpace& pl, float64_t t, size_t timestep_index)
 	{
 		// std::cerr << "pl. " << t << " " << pl.r()[1] << " " << pl.v()[1] << std::endl;
@@ -494,7 +944,7 @@ namespace wh
 		sr::convert::jacobi_to_helio_planets(planet_eta, planet_rj, planet_vj, pl);
 
 		// find the accelerations of the heliocentric velocities
-		helio_acc_planets(pl, timestep_index);
+		helio_acc_planets<N>(pl, planet_h0_log.get<true>()[timestep_index]);
 
 		Vf64_3* r_log = &pl.r_log().old;
 		Vf64_3* v_log = &pl.v_log().old;
@@ -1,5 +1,6 @@
 #include "types.cuh"
 #include "wh.cuh"
+#include "mvs_kernel.h"
 #include "convert.h"
 #include "util.cuh"
 #include <iostream>
@@ -10,9 +11,8 @@ namespace wh
 {
 	using namespace sr::data;
 
-	const float64_t TOLKEP = 1E-14;
-
-	struct MVSKernel
+	template<uint32_t N>
+	struct MVSKernel : public MVSKernelBase
 	{
 		const float64_t* planet_m;
 		const float64_t mu;
@@ -23,9 +23,9 @@ namespace wh
 		const float64_t dt;
 		const uint32_t maxkep;
 
-		const float64_t* planet_rh;
+		const float64_t* planet_rh2;
 
-		MVSKernel(const DevicePlanetPhaseSpace& planets, const Dvf64_3& h0_log, const Dvf64& _planet_rh, uint32_t _tbsize, float64_t _dt, uint32_t _maxkep) :
+		MVSKernel(const DevicePlanetPhaseSpace& planets, const Dvf64_3& h0_log, const Dvf64& _planet_rh2, uint32_t _tbsize, float64_t _dt, uint32_t _maxkep) :
 			planet_m(planets.m.data().get()),
 			mu(planets.m[0]),
 			planet_h0_log(h0_log.data().get()),
@@ -33,133 +33,10 @@ namespace wh
 			planet_n(static_cast<uint32_t>(planets.n_alive)),
 			tbsize(_tbsize),
 			dt(_dt),
-			planet_rh(_planet_rh.data().get()),
+			planet_rh2(_planet_rh2.data().get()),
 			maxkep(_maxkep)
 		{ }
 
-		__host__ __device__
-		static void kepeq(double dM, double ecosEo, double esinEo, double* dE, double* sindE, double* cosdE, uint16_t& flags, uint32_t maxkep)
-		{
-			double f, fp, delta;
-
-			*sindE = sin(*dE);
-			*cosdE = cos(*dE);
-
-			for (size_t i = 0; i < maxkep; i++)
-			{
-				f = *dE - ecosEo * (*sindE) + esinEo * (1. - *cosdE) - dM;
-				fp = 1. - ecosEo * (*cosdE) + esinEo * (*sindE);
-				delta = -f / fp;
-
-				*dE += delta;
-				*sindE = sin(*dE);
-				*cosdE = cos(*dE);
-
-#ifdef CUDA_KEPEQ_CHECK_CONVERGENCE
-				if (fabs(delta) < TOLKEP)
-				{
-					goto done;
-				}
-#endif
-			}
-
-			flags = static_cast<uint16_t>(flags | ((fabs(delta) > TOLKEP) << 3));
-done: ;
-		}
-
-		__host__ __device__
-		static void drift(f64_3& r, f64_3& v, uint16_t& flags, double dt, double mu, uint32_t maxkep)
-		{
-			float64_t dist = sqrt(r.lensq());
-			float64_t vdotr = v.x * r.x + v.y * r.y + v.z * r.z;
-
-			float64_t energy = v.lensq() * 0.5 - mu / dist;
-
-			flags = static_cast<uint16_t>(flags | ((energy >= 0) << 2));
-
-			float64_t a = -0.5 * mu / energy;
-			float64_t n_ = sqrt(mu / (a * a * a));
-			float64_t ecosEo = 1.0 - dist / a;
-			float64_t esinEo = vdotr / (n_ * a * a);
-			float64_t e = sqrt(ecosEo * ecosEo + esinEo * esinEo);
-
-			// subtract off an integer multiple of complete orbits
-			float64_t dM = dt * n_ - M_2PI * (int) (dt * n_ / M_2PI);
-
-			// remaining time to advance
-			float64_t _dt = dM / n_;
-
-			// call kepler equation solver with initial guess in dE already
-			float64_t dE = dM - esinEo + esinEo * cos(dM) + ecosEo * sin(dM);
-			float64_t sindE, cosdE;
-			kepeq(dM, ecosEo, esinEo, &dE, &sindE, &cosdE, flags, maxkep);
-
-			float64_t fp = 1.0 - ecosEo * cosdE + esinEo * sindE;
-			float64_t f = 1.0 + a * (cosdE - 1.0) / dist;
-			float64_t g = _dt + (sindE - dE) / n_;
-			float64_t fdot = -n_ * sindE * a / (dist * fp);
-			float64_t gdot = 1.0 + (cosdE - 1.0) / fp;
-
-			f64_3 r0 = r;
-			r = r0 * f + v * g;
-			v = r0 * fdot + v * gdot;
-		}
-
-		__host__ __device__
-		static void step_forward(f64_3& r, f64_3& v, uint16_t& flags, f64_3& a, uint32_t& deathtime_index, uint32_t _tbsize,
-				uint32_t planet_n, const f64_3* h0_log, const f64_3* r_log, const float64_t* m, const float64_t* rh, float64_t dt, float64_t mu, uint32_t maxkep)
-		{
-			deathtime_index = 0;
-
-			for (uint32_t step = 0; step < static_cast<uint32_t>(_tbsize); step++)
-			{
-				if (flags == 0)
-				{
-					// kick
-					v = v + a * (dt / 2);
-
-					drift(r, v, flags, dt, mu, maxkep);
-
-					a = h0_log[step];
-
-					// planet 0 is not counted
-					for (uint32_t i = 1; i < static_cast<uint32_t>(planet_n); i++)
-					{
-						f64_3 dr = r - r_log[step * (planet_n - 1) + i - 1];
-
-						float64_t rad = dr.lensq();
-
-						if (rad < rh[i] * rh[i] && flags == 0)
-						{
-							flags = flags & 0x00FF;
-							flags = static_cast<uint16_t>(flags | (i << 8) | 0x0001);
-						}
-
-						float64_t inv3 = 1. / (rad * sqrt(rad));
-						float64_t fac = m[i] * inv3;
-
-						a -= dr * fac;
-					}
-
-					float64_t rad = r.lensq();
-					if (rad < rh[0] * rh[0])
-					{
-						flags = flags & 0x00FF;
-						flags = flags | 0x0001;
-					}
-					if (rad > 500 * 500)
-					{
-						flags = flags | 0x0002;
-					}
-
-
-					v = v + a * (dt / 2);
-
-					deathtime_index = step + 1;
-				}
-			}
-		}
-
 		template<typename Tuple>
 		__host__ __device__
 		void operator()(Tuple args) const
@@ -168,7 +45,7 @@ done: ;
 			const f64_3* h0_log = this->planet_h0_log;
 			const f64_3* r_log = this->planet_r_log;
 			const float64_t* m = this->planet_m;
-			const float64_t* rh = this->planet_rh;
+			const float64_t* rh2 = this->planet_rh2;
 			float64_t _dt = this->dt;
 			float64_t _mu = this->mu;
 
@@ -179,8 +56,8 @@ done: ;
 			uint32_t deathtime_index = 0;
 			f64_3 a = thrust::get<1>(args);
 
-			step_forward(r, v, flags, a, deathtime_index, _tbsize,
-				planet_n, h0_log, r_log, m, rh, _dt, _mu, this->maxkep);
+			step_forward<N>(r, v, flags, a, deathtime_index, _tbsize,
+				planet_n, h0_log, r_log, m, rh2, _dt, _mu, this->maxkep);
 
 			thrust::get<0>(thrust::get<0>(args)) = r;
 			thrust::get<1>(thrust::get<0>(args)) = v;
@@ -191,9 +68,10 @@ done: ;
 		}
 	};
 
+	template<uint32_t N>
 	__global__
 	void MVSKernel_(f64_3* r, f64_3* v, uint16_t* flags, f64_3* a, uint32_t* deathtime_index,
-		uint32_t n, uint32_t tbsize, uint32_t planet_n, const f64_3* h0_log, const f64_3* r_log, const float64_t* m, const float64_t* rh, float64_t dt, float64_t mu, uint32_t maxkep)
+		uint32_t n, uint32_t tbsize, uint32_t planet_n, const f64_3* h0_log, const f64_3* r_log, const float64_t* m, const float64_t* rh2, float64_t dt, float64_t mu, uint32_t maxkep)
 	{
 		// per 1 timestep: (1 + planet_n) vec3s of float64
 		// assume up to 16 planets, so 17 * 3 * 8 = 408 byte per timestep
@@ -227,8 +105,8 @@ done: ;
 			f64_3 ai = a[i];
 			uint32_t deathtime_indexi;
 		
-			MVSKernel::step_forward(ri, vi, flagsi, ai, deathtime_indexi, tbsize,
-					planet_n, h0_log_shared, r_log_shared, m, rh, dt, mu, maxkep);
+			MVSKernelBase::step_forward<N>(ri, vi, flagsi, ai, deathtime_indexi, tbsize,
+					planet_n, h0_log_shared, r_log_shared, m, rh2, dt, mu, maxkep);
 
 			r[i] = ri;
 			v[i] = vi;
@@ -239,6 +117,36 @@ done: ;
 	}
 	
 
+	namespace
+	{
+		/** Launches the particle kernel with the planet count specialization picked by `dispatch_planet_count`. */
+		struct MVSKernelLaunch
+		{
+			WHCudaIntegrator& integrator;
+			cudaStream_t stream;
+			size_t planet_data_id;
+			const DevicePlanetPhaseSpace& pl;
+			DeviceParticlePhaseSpace& pa;
+			uint32_t grid_size, block_size, shared_mem;
+
+			template<uint32_t N>
+			void run()
+			{
+#ifndef CUDA_USE_SHARED_MEM_CACHE
+				auto it = thrust::make_zip_iterator(thrust::make_tuple(pa.begin(), integrator.device_begin()));
+				thrust::for_each(thrust::cuda::par.on(stream), it, it + pa.n_alive, MVSKernel<N>(pl, integrator.device_h0_log(planet_data_id), integrator.device_planet_rh2,
+						static_cast<uint32_t>(integrator.base.tbsize), integrator.base.dt, integrator.maxkep));
+#else
+				MVSKernel_<N><<<grid_size, block_size, shared_mem, stream>>>
+					(pa.r.data().get(), pa.v.data().get(), pa.deathflags.data().get(), integrator.device_particle_a.data().get(), pa.deathtime_index.data().get(),
+					static_cast<uint32_t>(pa.n_alive), static_cast<uint32_t>(integrator.base.tbsize), static_cast<uint32_t>(pl.n_alive),
+					integrator.device_h0_log(planet_data_id).data().get(), pl.r_log.data().get(), pl.m.data().get(),
+					integrator.device_planet_rh2.data().get(), integrator.base.dt, pl.m[0], integrator.maxkep);
+#endif
+			}
+		};
+	}
+
 	WHCudaIntegrator::WHCudaIntegrator() { }
 
 	WHCudaIntegrator::WHCudaIntegrator(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config)
@@ -248,9 +156,9 @@ done: ;
 		device_h0_log_1 = Dvf64_3(config.tbsize);
 		device_particle_a = Dvf64_3(pa.n());
 
-		device_planet_rh = Dvf64(pl.n());
+		device_planet_rh2 = Dvf64(pl.n());
 
-		memcpy_htd(device_planet_rh, base.planet_rh, 0);
+		memcpy_htd(device_planet_rh2, base.planet_rh2, 0);
 		maxkep = config.max_kep;
 		cudaStreamSynchronize(0);
 	}
@@ -295,8 +203,8 @@ done: ;
 	void WHCudaIntegrator::integrate_particles_timeblock_cuda(cudaStream_t stream, size_t planet_data_id, const DevicePlanetPhaseSpace& pl, DeviceParticlePhaseSpace& pa)
 	{
 #ifndef CUDA_USE_SHARED_MEM_CACHE
-		auto it = thrust::make_zip_iterator(thrust::make_tuple(pa.begin(), device_begin()));
-		thrust::for_each(thrust::cuda::par.on(stream), it, it + pa.n_alive, MVSKernel(pl, device_h0_log(planet_data_id), device_planet_rh, static_cast<uint32_t>(base.tbsize), base.dt, maxkep));
+		MVSKernelLaunch launch = { *this, stream, planet_data_id, pl, pa, 0, 0, 0 };
+		dispatch_planet_count(static_cast<uint32_t>(pl.n_alive), launch);
 #else
 		cudaDeviceProp prop;
 		cudaGetDeviceProperties(&prop, 0);
@@ -323,10 +231,9 @@ done: ;
 
 
 
-		MVSKernel_<<<grid_size, block_size, shared_mem, stream>>>
-			(pa.r.data().get(), pa.v.data().get(), pa.deathflags.data().get(), device_particle_a.data().get(), pa.deathtime_index.data().get(),
-			static_cast<uint32_t>(pa.n_alive), static_cast<uint32_t>(base.tbsize), static_cast<uint32_t>(pl.n_alive), device_h0_log(planet_data_id).data().get(), pl.r_log.data().get(), pl.m.data().get(),
-			device_planet_rh.data().get(), base.dt, pl.m[0], maxkep);
+		MVSKernelLaunch launch = { *this, stream, planet_data_id, pl, pa, grid_size, block_size, shared_mem };
+		dispatch_planet_count(static_cast<uint32_t>(pl.n_alive), launch);
+
 		cudaError_t error = cudaGetLastError();
 		if (error != cudaSuccess)
 		{
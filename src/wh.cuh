@@ -15,7 +15,7 @@ namespace wh
 		WHIntegrator base;
 
 		Dvf64_3 device_particle_a;
-		Dvf64 device_planet_rh;
+		Dvf64 device_planet_rh2;
 
 		uint32_t maxkep;
 
@@ -1,6 +1,7 @@
 #pragma once
 #include "data.h"
 #include "util.h"
+#include "mvs_kernel.h"
 
 #include <unordered_map>
 
@@ -11,8 +12,32 @@ namespace wh
 	using namespace sr::data;
 
 	bool kepeq(double dM, double ecosEo, double esinEo, double* dE, double* sindE, double* cosdE, uint32_t* iterations);
+	/**
+	 * Solves Kepler's equation with exactly `iterations` iterations, with no early exit. Returns true
+	 * if the result has not converged to `TOLKEP`, like `kepeq`.
+	 */
 	bool kepeq_fixed(double dM, double ecosEo, double esinEo, double* dE, double* sindE, double* cosdE, uint32_t iterations);
 
+	/**
+	 * The number of particles that the particle-major engine runs through a timeblock together.
+	 * A tile of particle states is small enough to stay in L1.
+	 */
+	const size_t PARTICLE_TILE_SIZE = 128;
+
+	/**
+	 * The planet arrays that the symplectic corrector works in. The corrector only needs these, so output can be
+	 * transformed into real coordinates without copying the integrator, which holds per-particle arrays.
+	 */
+	struct CorrectorScratch
+	{
+		Vf64 inverse_helio_cubed, inverse_jacobi_cubed;
+		Vf64 dist, energy, vdotr, mu;
+		Vu8 mask;
+		Vf64_3 rj, vj, a;
+
+		CorrectorScratch(size_t n);
+	};
+
 	class WHIntegrator
 	{
 	public:
@@ -34,11 +59,35 @@ namespace wh
 
 		Vf64 planet_rh;
 
+		/** The squares of `planet_rh`, which the acceleration kernels compare against squared distances. */
+		Vf64 planet_rh2;
+
+		/**
+		 * The indices of the unflagged particles, for the particle-major engine.
+		 * Particles that die are removed by `compact_active_particles`, so they cost nothing until the next resync.
+		 */
+		Vu32 particle_active;
+
 		size_t tbsize;
+		uint32_t maxkep;
+
+		/** Whether the particle Kepler solvers run a fixed `maxkep` iterations, see `CPU-Fixed-Kepler`. */
+		bool fixed_kepler;
+
+		/** The order of the symplectic corrector, 3, 5 or 7, or 0 for none. See `Symplectic-Corrector`. */
+		uint32_t corrector_order;
+
+		/** The square of `Mixed-Precision-Ratio`, or 0 if the particle-major engine keeps every planet term in double precision. */
+		float64_t mixed_ratio2;
 
 		double dt;
 
 		WHIntegrator();
+
+		/**
+		 * With a symplectic corrector, `pl` and `pa` are transformed from real coordinates into the mapping coordinates
+		 * that the integrator works on. The planet energy of the initial conditions must be taken before this.
+		 */
 		WHIntegrator(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, const Configuration& config);
 
 		void swap_logs();
@@ -47,19 +96,85 @@ namespace wh
 		void integrate_particles_timeblock(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length, float64_t t);
 		void gather_particles(const std::vector<size_t>& indices, size_t begin, size_t length);
 
+		/**
+		 * Particle-major timeblock engine. Integrates the particles with indices `particle_active[begin, begin + length)`
+		 * through the whole timeblock with the same step as `MVSKernelBase::step_forward`, one L1-sized tile of particles at a time.
+		 * The drift and acceleration use the batched kernels selected in `sr::kernels`; `integrate_particles_timeblock` keeps the scalar Kepler solver.
+		 * Unlike `integrate_particles_timeblock`, the death time of particles that die is set here.
+		 */
+		void integrate_active_particles_timeblock(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length, float64_t t);
+
+		/**
+		 * Measures the error of the mixed precision acceleration for the particles with indices `particle_active[begin, begin + length)`,
+		 * at the last step of the timeblock: the largest difference from the double precision acceleration, relative to the sun's pull.
+		 */
+		float64_t mixed_precision_error(const HostPlanetPhaseSpace& pl, const HostParticlePhaseSpace& pa, size_t begin, size_t length) const;
+
+		/**
+		 * Gets an upper bound on the relative error that `mixed_precision_error` measures: each single precision term is within
+		 * 7.5 units of 2^-24 of its value, and a planet's term is only taken in single precision where its pull is
+		 * at most m_i / (m_0 ratio^2) of the sun's.
+		 */
+		float64_t mixed_precision_bound(const HostPlanetPhaseSpace& pl) const;
+
+		/** Rebuilds the active particle list from the unflagged particles in [0, n_alive). Must be called after particles are reordered. */
+		void reset_active_particles(const HostParticlePhaseSpace& pa);
+
+		/** Removes particles that were flagged during the last timeblock from the active particle list. */
+		void compact_active_particles(const HostParticlePhaseSpace& pa);
+
+		/**
+		 * Steps the planets or particles through one timestep. `N` is the planet count specialization that
+		 * the timeblock was dispatched to, see `MAX_SPECIALIZED_PLANETS`.
+		 */
+		template<uint32_t N = 0>
 		void step_planets(HostPlanetPhaseSpace& pl, float64_t t, size_t timestep_index);
+		template<uint32_t N = 0>
 		void step_particles(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t begin, size_t length, float64_t t, size_t timestep_index);
 
 		static bool drift_single(float64_t t, float64_t mu, f64_3* r, f64_3* v);
-		static void drift(float64_t t, Vf64_3& r, Vf64_3& v, size_t start, size_t n, Vf64& dist, Vf64& energy, Vf64& vdotr, Vf64& mu, Vu8& mask);
-
-		template<bool old>
-		void helio_acc_particle(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& pa, size_t particle_index, float64_t time, size_t timestep_index);
 
-		template<bool old>
+		/**
+		 * Drifts [start, start + n) along their Kepler orbits. `Vec3` is `Vf64_3` for the planets
+		 * and `SoAf64_3` for the particles. If `fixed_kep` is nonzero, Kepler's equation is solved with
+		 * `kepeq_fixed` and that many iterations. Orbits where the solver does not converge are flagged with 0x08
+		 * in `flags` if it is given, and throw otherwise.
+		 */
+		template<typename Vec3>
+		static void drift(float64_t t, Vec3& r, Vec3& v, size_t start, size_t n, Vf64& dist, Vf64& energy, Vf64& vdotr, Vf64& mu, Vu8& mask,
+				uint16_t* flags = nullptr, uint32_t fixed_kep = 0);
+
+		template<uint32_t N>
+		void helio_acc_particle(HostParticlePhaseSpace& pa, size_t particle_index, float64_t time, uint32_t planet_n,
+				const f64_3& h0, const f64_3* r_log_step, const float64_t* m, const float64_t* rh2);
+
+		template<bool old, uint32_t N = 0>
 		void helio_acc_particles(const HostPlanetPhaseSpace& pl, HostParticlePhaseSpace& p, size_t begin, size_t length, float64_t time, size_t timestep_index);
 
-		void helio_acc_planets(HostPlanetPhaseSpace& p, size_t index);
+		/** Computes `planet_a` from the current planet positions, and the heliocentric acceleration `h0` that all the particles feel. */
+		template<uint32_t N = 0>
+		void helio_acc_planets(HostPlanetPhaseSpace& p, f64_3& h0);
+
+		/**
+		 * Transforms planets and particles at the same time, in the mapping coordinates that the integrator works on, into real coordinates
+		 * by applying the symplectic corrector of Wisdom, Holman & Touma (1996). The particles are optional. Only the alive, unflagged particles
+		 * are transformed. Does nothing if there is no corrector. The integrator is not changed, so this can be used for output while
+		 * the integration goes on.
+		 */
+		void to_real_coordinates(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa) const;
+
+		/** The inverse of `to_real_coordinates`. */
+		void to_mapping_coordinates(HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa);
+
+		/**
+		 * The building blocks of the corrector: a Kepler drift of the planets and particles by `t`,
+		 * and a kick of their heliocentric velocities by the interaction accelerations for `t`.
+		 */
+		void corrector_kepler_step(CorrectorScratch& scratch, HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa, float64_t t) const;
+		void corrector_interaction_step(CorrectorScratch& scratch, HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa, float64_t t) const;
+
+		/** Applies the kernel of the corrector, or its inverse if `inverse` is -1. */
+		void apply_corrector(CorrectorScratch& scratch, HostPlanetPhaseSpace& pl, HostParticlePhaseSpace* pa, float64_t inverse) const;
 	};
 
 	void calculate_planet_metrics(const HostPlanetPhaseSpace& p, double* energy, f64_3* l);
@@ -35,7 +35,9 @@ int main(int argc, char** argv)
 
 		bool ishelio;
 		bool binary = false;
+		bool columnar = false;
 		bool momentum = false;
+		double time = 0;
 
 		const std::vector<std::string>& commands = args["<commands>"].asStringList();
 
@@ -54,10 +56,17 @@ int main(int argc, char** argv)
 			else if (arg == "binary")
 			{
 				binary = true;
+				columnar = false;
+			}
+			else if (arg == "columnar")
+			{
+				binary = true;
+				columnar = true;
 			}
 			else if (arg == "ascii")
 			{
 				binary = false;
+				columnar = false;
 			}
 			else if (arg == "read")
 			{
@@ -65,7 +74,7 @@ int main(int argc, char** argv)
 				config.readbinary = binary;
 				config.readmomenta = momentum;
 
-				load_data(hd.planets, hd.particles, config);
+				load_data(hd.planets, hd.particles, config, &time);
 
 				if (hd.planets.r()[0].lensq() < EPS && hd.planets.r()[0].lensq() < EPS) ishelio = true;
 				else
@@ -109,10 +118,10 @@ int main(int argc, char** argv)
 			else if (arg == "write")
 			{
 				config.hybridout = commands[i + 1];
-				config.writebinary = binary;
+				config.writebinary = columnar ? 2 : binary ? 1 : 0;
 				config.writemomenta = momentum;
 
-				save_data(hd.planets.base, hd.particles, config, config.hybridout);
+				save_data(hd.planets.base, hd.particles, config, config.hybridout, time);
 
 				i++;
 			}
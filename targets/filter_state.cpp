@@ -5,6 +5,7 @@
 #include <ctime>
 #include <thread>
 #include <iomanip>
+#include <numeric>
 
 #include "../docopt/docopt.h"
 #include "../src/data.h"
@@ -22,6 +23,7 @@ Options:
     -c <list>, --csv <list>            Comma-separated list of paths to csvs that can contain attributes to filter by
     -u, --union                        Take union of criteria instead of intersection
     -b, --binary                       Read binary input
+    -a, --alive-only                   Only consider the particles that are alive
     -B, --barycentric                  Calculate barycentric elements
     -o <file>, --output <file>         Write output filtered state
 )";
@@ -161,7 +163,41 @@ int main(int argc, char** argv)
 		config.readbinary = args["--binary"].asBool();
 		config.readmomenta = false;
 
-		load_data(hd.planets, hd.particles, config);
+		bool alive_only = args["--alive-only"].asBool();
+
+		// From a columnar state, only the columns that the criteria and the output use are loaded
+		uint32_t columns = sr::data::state_column::ID | sr::data::state_column::R | sr::data::state_column::V;
+		for (const auto& crit : criteria)
+		{
+			if (crit.variable == "deathtime" || crit.variable == "killer")
+			{
+				columns |= sr::data::state_column::DEATHFLAGS | sr::data::state_column::DEATHTIME;
+			}
+		}
+		if (args["--output"])
+		{
+			columns = sr::data::state_column::ALL;
+		}
+
+		if (config.readbinary && sr::data::is_columnar_state(config.hybridin))
+		{
+			sr::data::load_data_columnar(hd.planets, hd.particles, config, columns, alive_only);
+		}
+		else
+		{
+			load_data(hd.planets, hd.particles, config);
+
+			if (alive_only)
+			{
+				std::vector<size_t> alive(hd.particles.n_alive());
+				std::iota(alive.begin(), alive.end(), 0);
+
+				sr::data::HostParticlePhaseSpace alive_particles;
+				hd.particles.filter(alive, alive_particles);
+				hd.particles = alive_particles;
+			}
+		}
+
 		hd.particles.sort_by_id(0, hd.particles.n());
 		if (args["--barycentric"])
 		{
@@ -177,10 +213,41 @@ int main(int argc, char** argv)
 		if (has_init)
 		{
 			config.hybridin = args["--initial-state"].asString();
-			load_data(hd_init.planets, hd_init.particles, config);
+			if (config.readbinary && sr::data::is_columnar_state(config.hybridin))
+			{
+				sr::data::load_data_columnar(hd_init.planets, hd_init.particles, config,
+						sr::data::state_column::ID | sr::data::state_column::R | sr::data::state_column::V, false);
+			}
+			else
+			{
+				load_data(hd_init.planets, hd_init.particles, config);
+			}
 
 			hd_init.particles.sort_by_id(0, hd_init.particles.n());
 
+			if (alive_only)
+			{
+				// The initial state still has the particles that have died since, so only the survivors are compared
+				std::vector<size_t> survivors(hd.particles.n());
+				hd_init.particles.build_id_index();
+
+				try
+				{
+					for (size_t i = 0; i < hd.particles.n(); i++)
+					{
+						survivors[i] = hd_init.particles.index_of(hd.particles.id()[i]);
+					}
+				}
+				catch (std::out_of_range&)
+				{
+					throw std::runtime_error("Initial state is not congruent with input state");
+				}
+
+				sr::data::HostParticlePhaseSpace surviving_particles;
+				hd_init.particles.filter(survivors, surviving_particles);
+				hd_init.particles = surviving_particles;
+			}
+
 			if (hd_init.particles.id() != hd.particles.id())
 			{
 				throw std::runtime_error("Initial state is not congruent with input state");
@@ -12,6 +12,8 @@ GLISSE Integrator
 #include <thread>
 #include <cmath>
 #include <iomanip>
+#include <memory>
+#include <algorithm>
 
 
 #include <execinfo.h>
@@ -22,6 +24,11 @@ GLISSE Integrator
 #include "../src/wh.h"
 #include "../src/convert.h"
 #include "../src/util.h"
+#include "../src/background_writer.h"
+#include "../src/buffer_pool.h"
+#include "../src/forked_writer.h"
+#include "../src/allocation_counter.h"
+#include "../src/autotune.h"
 #include "../docopt/docopt.h"
 
 static const char USAGE[] = R"(sr(_cpu)
@@ -30,6 +37,8 @@ Usage:
 
 Options:
     -h, --help         Show this screen.
+    --autotune         Time the CPU engine parameters on a sample of the initial state before integrating,
+                       and cache the choice for later runs on this machine.
 )";
 
 volatile sig_atomic_t end_loop = 0;
@@ -42,6 +51,39 @@ void term(int signum)
 	}
 }
 
+/**
+ * Saves the state at the current time, transformed into real coordinates if a symplectic corrector is enabled.
+ * The state the integrator works on is left untouched.
+ */
+void save_real_data(const sr::exec::ExecutorFacade& ex, const sr::data::Configuration& config, const std::string& outfile)
+{
+	if (!config.corrector_order)
+	{
+		save_data(ex.hd.planets_snapshot, ex.hd.particles, config, outfile, ex.t);
+		return;
+	}
+
+	sr::data::HostPlanetSnapshot planets = ex.hd.planets_snapshot;
+	sr::data::HostParticlePhaseSpace particles = ex.hd.particles;
+	ex.to_real_coordinates(planets, &particles);
+	save_data(planets, particles, config, outfile, ex.t);
+}
+
+/** Writes dump number `dump_num`: the configuration to continue from it, and the state, in the format that `out_config` reads. */
+void write_dump(const sr::data::Configuration& config, const sr::data::Configuration& out_config, uint32_t dump_num,
+		const sr::data::HostPlanetSnapshot& planets, const sr::data::HostParticlePhaseSpace& particles)
+{
+	std::ostringstream ss;
+	ss << "dumps/config." << dump_num << ".out";
+
+	std::ofstream configout(sr::util::joinpath(config.outfolder, ss.str()));
+	write_configuration(configout, out_config);
+
+	ss = std::ostringstream();
+	ss << "dumps/state." << dump_num << ".out";
+	save_data(planets, particles, out_config, sr::util::joinpath(config.outfolder, ss.str()), out_config.t_0);
+}
+
 int main(int argc, char** argv)
 {
 	std::ios_base::sync_with_stdio(false);
@@ -111,12 +153,42 @@ int main(int argc, char** argv)
 
 	sr::data::HostData hd;
 
+	if (load_data(hd.planets, hd.particles, config)) return -1;
+
+	// The resyncs keep this order, so tracks can be written without sorting
+	hd.particles.sort_by_id(0, hd.particles.n_alive());
+
+#ifdef NO_CUDA
+	{
+		// The parameters are only filled in where the configuration leaves them to be chosen automatically
+		std::string cache_path = sr::exec::tuning_cache_path(config);
+		std::string key = sr::exec::tuning_key(hd.planets.n_alive() - 1, hd.particles.n_alive());
+		sr::exec::TuningParameters tuning;
+
+		if (args["--autotune"].asBool())
+		{
+			tuning = sr::exec::autotune(hd, config, tout);
+			if (!cache_path.empty()) sr::exec::save_tuning(cache_path, key, tuning);
+			sr::exec::apply_tuning(tuning, hd.particles.n_alive(), &config_mut);
+		}
+		else if (!cache_path.empty() && sr::exec::load_tuning(cache_path, key, &tuning))
+		{
+			tout << "Using the cached tuning for " << key << " from " << cache_path << std::endl;
+			sr::exec::apply_tuning(tuning, hd.particles.n_alive(), &config_mut);
+		}
+	}
+#else
+	if (args["--autotune"].asBool())
+	{
+		tout << "Warning: --autotune is only supported in CPU-only mode" << std::endl;
+	}
+#endif
+
 	sr::exec::ExecutorFacade ex(hd, config, tout);
 
 	ex.t = config.t_0;
 
-	if (load_data(hd.planets, hd.particles, config)) return -1;
-	save_data(hd.planets.base, hd.particles, config, sr::util::joinpath(config.outfolder, "state.in"));
+	save_data(hd.planets.base, hd.particles, config, sr::util::joinpath(config.outfolder, "state.in"), config.t_0);
 
 	std::time_t t = std::time(nullptr);
 	std::tm tm = *std::localtime(&t);
@@ -137,30 +209,81 @@ int main(int argc, char** argv)
 
 	uint32_t track_num = 1;
 
+	// Tracks and dumps are copied on the main thread, at the time they are taken, and written from the copies
+	// on the writer thread. The track stream is only touched by the writer thread from here on.
+	// The particle copies are taken from a pool, and go back to it once they are written.
+	sr::util::BufferPool<sr::data::HostParticlePhaseSpace> output_buffers;
+	sr::util::BackgroundWriter writer(config.writer_queue_size, [&trackout]() { trackout.flush(); });
+	sr::util::ForkedWriter dump_processes(config.max_dump_processes);
+
+	// Separate reports, since the log, time.out and the allocation check each have their own interval
+	sr::util::AllocationReport log_allocations, timelog_allocations, check_allocations;
+
+	static const size_t status_scope = sr::util::allocation_scope_id("status");
+	static const size_t dump_scope = sr::util::allocation_scope_id("dump");
+	static const size_t dump_write_scope = sr::util::allocation_scope_id("dump_write");
+	static const size_t track_scope = sr::util::allocation_scope_id("track");
+	static const size_t track_write_scope = sr::util::allocation_scope_id("track_write");
+
+	if (config.allocation_check_after != 0 && !sr::util::allocation_stats_enabled())
+	{
+		tout << "Warning: Allocation-Check-After has no effect unless built with ALLOCATION_STATS=1" << std::endl;
+	}
+
 	try
 	{
 		trackout = std::ofstream(sr::util::joinpath(config.outfolder, "tracks/track.0.out"), std::ios_base::binary);
 
-		while (ex.t < config.t_f)
+		// Adaptive timeblocks only stop at the end of a whole interval, like fixed ones
+		while (ex.t < config.t_f || !ex.interval_finished)
 		{
 			double cputimeout, gputimeout;
 		       	ex.loop(&cputimeout, &gputimeout);
 
 			double timediff = gputimeout - cputimeout;
 
+			if (config.allocation_check_after != 0)
+			{
+				if (counter >= config.allocation_check_after && ex.loop_allocations > 0)
+				{
+					tout << "Allocations by scope in the last timeblock, including the queued jobs (count, bytes):" << std::endl;
+					check_allocations.write(tout, "  ");
+
+					std::ostringstream ss;
+					ss << "Error: timeblock " << counter + 1 << " made " << ex.loop_allocations << " heap allocations after the warm-up";
+					throw std::runtime_error(ss.str());
+				}
+
+				check_allocations.skip();
+			}
+
+			// The output intervals count whole intervals of Time-Block-Size steps, which adaptive timeblocks only make up together
+			if (!ex.interval_finished) continue;
+
 			counter++;
 
-			ex.add_job([&timelog, &tout, &ex, &config, counter, timediff]()
+			if (config.fork_dumps)
+			{
+				dump_processes.reap();
+			}
+
+			ex.add_job([&timelog, &tout, &ex, &config, &writer, &log_allocations, &timelog_allocations, counter, timediff]()
 				{
+					sr::util::AllocationScope allocation_scope(status_scope);
+
 					bool output_energy = config.energy_every != 0 && (counter % config.energy_every == 0);
 					bool log_out = config.print_every != 0 && (counter % config.print_every == 0);
 
 
 					if (!log_out && !output_energy) return;
 
+					sr::data::HostPlanetPhaseSpace planets;
+					planets.base = ex.hd.planets.base;
+					ex.to_real_coordinates(planets.base, nullptr);
+
 					double e_;
 					f64_3 l_;
-					sr::wh::calculate_planet_metrics(ex.hd.planets, &e_, &l_);
+					sr::wh::calculate_planet_metrics(planets, &e_, &l_);
 					double elapsed = ex.time();
 					double total = elapsed * (config.t_f - config.t_0) / (ex.t - config.t_0);
 
@@ -169,6 +292,7 @@ int main(int argc, char** argv)
 						timelog << std::setprecision(13) << "time " << elapsed << " " << ex.t << " " << ex.hd.particles.n_alive() << std::endl;
 						timelog << "ep " << e_ << std::endl;
 						timelog << "lp " << l_ << std::endl;
+						timelog_allocations.write(timelog, "alloc ");
 					}
 
 					if (log_out)
@@ -180,6 +304,18 @@ int main(int argc, char** argv)
 							ex.hd.particles.n_alive() << " particles remaining" << std::endl;
 
 						tout << "GPU took " << std::setprecision(4) << timediff << " ms longer than CPU" << std::endl;
+						if (config.adaptive_tbsize)
+						{
+							tout << "Time block size: " << ex.timeblock_steps << std::endl;
+						}
+						tout << "Output queue: " << writer.depth() << "/" << writer.capacity() << std::endl;
+
+						if (sr::util::allocation_stats_enabled())
+						{
+							tout << "Heap allocations in the last timeblock: " << ex.loop_allocations << std::endl;
+							tout << "Allocations by scope since the last log (count, bytes):" << std::endl;
+							log_allocations.write(tout, "  ");
+						}
 					}
 				});
 			
@@ -196,39 +332,80 @@ int main(int argc, char** argv)
 					out_config.t_f = config.t_f - config.t_0 + ex.t;
 					out_config.t_0 = ex.t;
 					out_config.writesplit = false;
-					out_config.writebinary = true;
+					// Dumps are binary, in the columnar format if the run writes it, and the dump configuration reads them back
+					out_config.writebinary = std::max<uint32_t>(config.writebinary, 1);
+					out_config.readbinary = true;
 
-					ex.add_job([&tout, &ex, &out_config, &config, &dump_num]()
+					uint32_t this_dump = dump_num++;
+					ex.add_job([&tout, &ex, &writer, &dump_processes, &output_buffers, out_config, &config, this_dump]()
 						{
+							sr::util::AllocationScope allocation_scope(dump_scope);
 							tout << "Dumping to disk. t = " << ex.t << std::endl;
-							std::ostringstream ss;
-							ss << "dumps/config." << dump_num << ".out";
 
-							std::ofstream configout(sr::util::joinpath(config.outfolder, ss.str()));
-							write_configuration(configout, out_config);
-
-							ss = std::ostringstream();
-							ss << "dumps/state." << dump_num << ".out";
-							save_data(ex.hd.planets_snapshot, ex.hd.particles, config, sr::util::joinpath(config.outfolder, ss.str()));
-
-							dump_num++;
+							if (config.fork_dumps)
+							{
+								// The jobs run while nothing writes to the host state, so the fork sees it whole.
+								// The child has its own copy-on-write image of it, so it can transform the state in place.
+								std::ostringstream name;
+								name << "dump " << this_dump;
+
+								bool forked = dump_processes.spawn(name.str(), [&ex, &config, out_config, this_dump]()
+									{
+										ex.to_real_coordinates(ex.hd.planets_snapshot, &ex.hd.particles);
+										write_dump(config, out_config, this_dump, ex.hd.planets_snapshot, ex.hd.particles);
+									});
+
+								if (forked) return;
+								tout << "Warning: could not fork a dump process, writing the dump on the writer thread" << std::endl;
+							}
+
+							// A dump is a state to continue from, so the dead particles are written too
+							std::shared_ptr<sr::data::HostPlanetSnapshot> planets = std::make_shared<sr::data::HostPlanetSnapshot>(ex.hd.planets_snapshot);
+							std::shared_ptr<sr::data::HostParticlePhaseSpace> particles = output_buffers.acquire();
+							particles->copy_for_output(ex.hd.particles, ex.hd.particles.n());
+							ex.to_real_coordinates(*planets, particles.get());
+
+							writer.push([&config, out_config, this_dump, planets, particles]()
+								{
+									sr::util::AllocationScope write_scope(dump_write_scope);
+									write_dump(config, out_config, this_dump, *planets, *particles);
+								});
 						});
 				}
 
 				if (track)
 				{
-					if (config.split_track_file > 0 && trackout.tellp() > config.split_track_file)
-					{
-						std::ostringstream ss;
-						ss << "tracks/track." << track_num++ << ".out";
-						trackout = std::ofstream(sr::util::joinpath(config.outfolder, ss.str()), std::ios_base::binary);
-					}
-
-					ex.add_job([&trackout, &ex, &config]()
+					ex.add_job([&trackout, &track_num, &tout, &ex, &writer, &output_buffers, &config]()
 						{
-							sr::data::HostParticleSnapshot snapshot_copy = ex.hd.particles.base;
-							snapshot_copy.sort_by_id(0, snapshot_copy.n_alive);
-							sr::data::save_binary_track(trackout, ex.hd.planets_snapshot, snapshot_copy, ex.t, true, config.write_bary_track);
+							sr::util::AllocationScope allocation_scope(track_scope);
+
+							// Only the main thread pushes, so the queue cannot fill up between here and the push
+							if (config.drop_track_frames && writer.depth() >= writer.capacity())
+							{
+								tout << "Warning: output queue is full, dropping the track frame at t = " << ex.t << std::endl;
+								return;
+							}
+
+							// Tracks only hold the alive particles
+							std::shared_ptr<sr::data::HostPlanetSnapshot> planets = std::make_shared<sr::data::HostPlanetSnapshot>(ex.hd.planets_snapshot);
+							std::shared_ptr<sr::data::HostParticlePhaseSpace> particles = output_buffers.acquire();
+							particles->copy_for_output(ex.hd.particles, ex.hd.particles.n_alive());
+							ex.to_real_coordinates(*planets, particles.get());
+							double time = ex.t;
+
+							writer.push([&trackout, &track_num, &config, planets, particles, time]()
+								{
+									sr::util::AllocationScope write_scope(track_write_scope);
+
+									if (config.split_track_file > 0 && trackout.tellp() > config.split_track_file)
+									{
+										std::ostringstream ss;
+										ss << "tracks/track." << track_num++ << ".out";
+										trackout = std::ofstream(sr::util::joinpath(config.outfolder, ss.str()), std::ios_base::binary);
+									}
+
+									sr::data::save_binary_track(trackout, *planets, particles->base, time, true, config.write_bary_track);
+								});
 						});
 				}
 			}
@@ -278,7 +455,7 @@ int main(int argc, char** argv)
 						tout << "Dumping to disk. t = " << ex.t << std::endl;
 						std::ofstream configout(tokens[1]);
 						write_configuration(configout, out_config);
-						save_data(ex.hd.planets_snapshot, ex.hd.particles, config, tokens[2]);
+						save_real_data(ex, config, tokens[2]);
 					}
 					else
 					{
@@ -305,8 +482,28 @@ int main(int argc, char** argv)
 	ex.finish();
 	ex.download_data(true);
 
+	try
+	{
+		writer.drain();
+	}
+	catch (const std::exception& e)
+	{
+		tout << "Exception caught while writing output: " << e.what() << std::endl;
+		crashed = true;
+	}
+
+	try
+	{
+		dump_processes.drain();
+	}
+	catch (const std::exception& e)
+	{
+		tout << "Exception caught while writing output: " << e.what() << std::endl;
+		crashed = true;
+	}
+
 	tout << "Saving to disk." << std::endl;
-	save_data(hd.planets_snapshot, hd.particles, config, sr::util::joinpath(config.outfolder, "state.out"));
+	save_real_data(ex, config, sr::util::joinpath(config.outfolder, "state.out"));
 
 	sr::data::Configuration out_config = config.output_config();
 	out_config.t_f = config.t_f - config.t_0 + ex.t;
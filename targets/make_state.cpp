@@ -129,7 +129,10 @@ int main(int argc, char** argv)
 			double sinanom = std::sqrt(1.0 - e*e) * sindE/(1.0 - e*cosdE);
 			double anom = std::atan2(sinanom,cosanom);
 		   
-			sr::convert::from_elements(mu,a,e,inc,O,o, anom, &hd.particles.r()[i], &hd.particles.v()[i]);
+			f64_3 pos, vel;
+			sr::convert::from_elements(mu,a,e,inc,O,o, anom, &pos, &vel);
+			hd.particles.r()[i] = pos;
+			hd.particles.v()[i] = vel;
 			hd.particles.id()[i] = static_cast<uint32_t>(i);
 			hd.particles.deathflags()[i] = 0;
 			hd.particles.deathtime()[i] = 0;